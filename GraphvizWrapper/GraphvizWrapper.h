@@ -4,6 +4,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 #ifdef _WIN32
     #define STRDUP _strdup
@@ -48,6 +51,82 @@ static int rj_flush(void* stream)
 static Agiodisc_t ioDisc = { rj_afread, rj_putstr, rj_flush };
 static Agdisc_t disc = { 0, &ioDisc };
 
+// A buffer in memory that is read by agread without copying it first
+struct rj_membuffer
+{
+    const char* data;
+    size_t length;
+    size_t position;
+};
+
+// A piece of output in a list of fixed size buffers, see rj_agwrite_chunks
+struct rj_chunk
+{
+    rj_chunk* next;
+    size_t length;
+    char* data;
+};
+
+// Graphviz does not properly support windows line endings when it comes to attribute line continuations,
+// so we drop the \r of every \r\n while reading.
+static int rj_memread(void* stream, char* buffer, int bufsize)
+{
+    rj_membuffer* mb = (rj_membuffer*)stream;
+    size_t written = 0;
+    while (written < (size_t)bufsize && mb->position < mb->length)
+    {
+        const char* start = mb->data + mb->position;
+        size_t available = min((size_t)bufsize - written, mb->length - mb->position);
+        const char* cr = (const char*)memchr(start, '\r', available);
+        size_t chunk = cr ? (size_t)(cr - start) : available;
+        memcpy(buffer + written, start, chunk);
+        written += chunk;
+        mb->position += chunk;
+        if (cr)
+        {
+            mb->position++;
+            bool crlf = mb->position < mb->length && mb->data[mb->position] == '\n';
+            if (!crlf)
+                buffer[written++] = '\r';
+        }
+    }
+    return (int)written;
+}
+
+// Graphs read from memory are written like any other graph, through the ostream based putstr
+static Agiodisc_t memIoDisc = { rj_memread, rj_putstr, rj_flush };
+static Agdisc_t memDisc = { 0, &memIoDisc };
+
+// Read from a FILE*, dropping the \r of every \r\n like rj_memread
+static int rj_fileread(void* stream, char* buffer, int bufsize)
+{
+    FILE* file = (FILE*)stream;
+    int written = 0;
+    // Loop, because returning 0 would signal the end of the file when the chunk only contained a \r
+    while (written == 0)
+    {
+        int read = (int)fread(buffer, 1, bufsize, file);
+        if (read == 0)
+            return 0;
+        for (int i = 0; i < read; i++)
+        {
+            if (buffer[i] == '\r')
+            {
+                int next = i + 1 < read ? buffer[i + 1] : getc(file);
+                if (i + 1 == read && next != EOF)
+                    ungetc(next, file);
+                if (next == '\n')
+                    continue;
+            }
+            buffer[written++] = buffer[i];
+        }
+    }
+    return written;
+}
+
+static Agiodisc_t fileIoDisc = { rj_fileread, rj_putstr, rj_flush };
+static Agdisc_t fileDisc = { 0, &fileIoDisc };
+
 extern "C" {
 
     API void free_str(char* str);
@@ -59,10 +138,19 @@ extern "C" {
     API Agnode_t* rj_aghead(Agedge_t* edge);
     API Agnode_t* rj_agtail(Agedge_t* edge);
     API int rj_ageqedge(Agedge_t* e, Agedge_t* f);
+    API int rj_agisanonymous(void* obj);
 
     // Some wrappers around existing cgraph functions to handle string marshaling
     API const char* rj_agmemwrite(Agraph_t* g);
+    // Write the graph into a single buffer without an extra copy, which the caller has to free with free_str
+    API char* rj_agwrite_buffer(Agraph_t* g, size_t* length);
+    // Write the graph into a list of fixed size chunks, which the caller frees one at a time with rj_free_chunk
+    API rj_chunk* rj_agwrite_chunks(Agraph_t* g);
+    API const char* rj_chunk_data(rj_chunk* chunk, size_t* length);
+    API rj_chunk* rj_free_chunk(rj_chunk* chunk);
     API Agraph_t* rj_agmemread(const char* s);
+    API Agraph_t* rj_agmemread_buffer(const char* data, size_t length);
+    API Agraph_t* rj_agread_file(const char* path);
     API Agraph_t* rj_agopen(char* name, int graphtype);
     API const char* rj_sym_key(Agsym_t* sym);
 
@@ -85,65 +173,56 @@ extern "C" {
 
     API void clone_attribute_declarations(Agraph_t* from, Agraph_t* to);
     API void convert_to_undirected(Agraph_t* graph);
+    // Copy the nodes, edges and subgraphs of g into target, including their attribute values
+    API void rj_clone_into(Agraph_t* g, Agraph_t* target);
+    // Create a new root graph with the contents and the graph attributes of g
+    API Agraph_t* rj_clone_graph(Agraph_t* g, const char* name);
+    // Bulk construction of a root graph, see GraphBuilder
+    API Agraph_t* rj_build_graph(const char* name, int graphtype, const char* strings, const int* offsets,
+        int node_count, int edge_name_count, const int* tails, const int* heads, const int* edge_names, int edge_count,
+        const int* attribute_kinds, int attribute_count);
+    // Binary snapshots of a graph, see rj_write_snapshot for the format. The caller has to call free_str
+    // to free the snapshot. Reading returns null if the data is not a valid snapshot.
+    API char* rj_write_snapshot(Agraph_t* g, int* length);
+    API Agraph_t* rj_read_snapshot(const char* data, int length);
+    // Compare the nodes and edges of a and b by name, see graph_diff for the layout of the result
+    API char* rj_compare_graphs(Agraph_t* a, Agraph_t* b, int compare_attributes);
+    // Order independent 128 bit hash of the structure of g and the values of the given attributes,
+    // which are passed in the column layout of set_node_attribute_column. The result holds two values.
+    API void rj_graph_fingerprint(Agraph_t* g, const char* attributes, const int* offsets, int count, uint64_t* result);
+    // Laying out connected components separately
+    API Agraph_t** rj_split_components(Agraph_t* g, int* count);
+    API void rj_merge_layout(Agraph_t* target, Agraph_t* layout, double dx, double dy);
+    API Agraph_t* rj_add_subgraph_from_nodes(Agraph_t* g, const char* name, Agnode_t** nodes, int count);
+    // A descendant of g with the given name, looked up in an index of the root graph that is built on first use
+    API Agraph_t* rj_find_descendant(Agraph_t* g, const char* name);
+    // Delete the given descendants of g in a single traversal, returning the number deleted
+    API int rj_delete_subgraphs(Agraph_t* g, Agraph_t** subgraphs, int count);
+    // Traversals, returning arrays that are freed with free_str
+    API Agnode_t** rj_traverse(Agraph_t* g, Agnode_t* source, int order, int direction, int** depths, int* count);
+    API Agnode_t** rj_topological_sort(Agraph_t* g, int* count);
+
+    // Bulk attribute access for all nodes or edges of a graph, in the order of Graph.Nodes() and Graph.Edges()
+    API char* get_node_attribute_column(Agraph_t* g, Agsym_t* sym);
+    API char* get_edge_attribute_column(Agraph_t* g, Agsym_t* sym);
+    API int set_node_attribute_column(Agraph_t* g, Agsym_t* sym, const char* data, const int* offsets, int count);
+    API int set_edge_attribute_column(Agraph_t* g, Agsym_t* sym, const char* data, const int* offsets, int count);
+#pragma endregion
+
+#pragma region "GVC"
+    // A context with the given plugin libraries as builtins, e.g. "dot_layout" for gvplugin_dot_layout,
+    // passed in the column layout of set_node_attribute_column. Returns null if a library cannot be loaded.
+    API GVC_t* rj_context_plugins(const char* names, const int* offsets, int count, int demand_loading);
+    API int rj_free_context(GVC_t* gvc);
 #pragma endregion
 
 #pragma region "xdot"
 
-    API size_t get_cnt(xdot* xdot);
-    API xdot_op* get_ops(xdot* xdot);
-    API xdot_kind get_kind(xdot_op* op);
-    API xdot_rect* get_ellipse(xdot_op* op);
-    API xdot_polyline* get_polygon(xdot_op* op);
-    API xdot_polyline* get_polyline(xdot_op* op);
-    API xdot_polyline* get_bezier(xdot_op* op);
-    API xdot_text* get_text(xdot_op* op);
-    API xdot_image* get_image(xdot_op* op);
-    API char* get_color(xdot_op* op);
-    API xdot_color* get_grad_color(xdot_op* op);
-    API xdot_font* get_font(xdot_op* op);
-    API char* get_style(xdot_op* op);
-    API unsigned int get_fontchar(xdot_op* op);
-    API xdot_rect* get_pos(xdot_image* img);
-    API char* get_name_image(xdot_image* img);
-    API double get_size(xdot_font* font);
-    API char* get_name_font(xdot_font* font);
-    API xdot_grad_type get_type(xdot_color* clr);
-    API char* get_clr(xdot_color* clr);
-    API xdot_linear_grad* get_ling(xdot_color* clr);
-    API xdot_radial_grad* get_ring(xdot_color* clr);
-    API double get_x_text(xdot_text* txt);
-    API double get_y_text(xdot_text* txt);
-    API xdot_align get_align(xdot_text* txt);
-    API double get_width(xdot_text* txt);
-    API char* get_text_str(xdot_text* txt);
-    API double get_x0_ling(xdot_linear_grad* ling);
-    API double get_y0_ling(xdot_linear_grad* ling);
-    API double get_x1_ling(xdot_linear_grad* ling);
-    API double get_y1_ling(xdot_linear_grad* ling);
-    API int get_n_stops_ling(xdot_linear_grad* ling);
-    API xdot_color_stop* get_stops_ling(xdot_linear_grad* ling);
-    API double get_x0_ring(xdot_radial_grad* ring);
-    API double get_y0_ring(xdot_radial_grad* ring);
-    API double get_r0_ring(xdot_radial_grad* ring);
-    API double get_x1_ring(xdot_radial_grad* ring);
-    API double get_y1_ring(xdot_radial_grad* ring);
-    API double get_r1_ring(xdot_radial_grad* ring);
-    API int get_n_stops_ring(xdot_radial_grad* ring);
-    API xdot_color_stop* get_stops_ring(xdot_radial_grad* ring);
-    API float get_frac(xdot_color_stop* stop);
-    API char* get_color_stop(xdot_color_stop* stop);
-    API size_t get_cnt_polyline(xdot_polyline* polyline);
-    API xdot_point* get_pts_polyline(xdot_polyline* polyline);
-    API double get_x_point(xdot_point* point);
-    API double get_y_point(xdot_point* point);
-    API double get_z_point(xdot_point* point);
-    API double get_x_rect(xdot_rect* rect);
-    API double get_y_rect(xdot_rect* rect);
-    API double get_w_rect(xdot_rect* rect);
-    API double get_h_rect(xdot_rect* rect);
-    API xdot_color_stop* get_color_stop_at_index(xdot_color_stop* stops, int index);
-    API xdot_op* get_op_at_index(xdot_op* ops, int index);
-    API xdot_point* get_pt_at_index(xdot_point* pts, int index);
+    // Version of the buffer layout produced by pack_xdot, bump this when the layout changes
+#define XDOT_PACK_VERSION 1
+#define XDOT_PACK_HEADER_INTS 5
+    API char* pack_xdot(xdot* xdot);
+    API char* rj_translate_xdot(const char* s, double dx, double dy);
 #pragma endregion
 
 #pragma region "testing/debugging"
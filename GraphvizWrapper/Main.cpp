@@ -2,8 +2,21 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "GraphvizWrapper.h"
 
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <dlfcn.h>
+#endif
+
 using namespace std;
 
 // Relevant Graphviz Documentation: https://graphviz.org/docs/library/
@@ -33,6 +46,51 @@ Agraph_t* rj_agmemread(const char* s)
     return g;
 }
 
+// Read a graph directly from a UTF-8 buffer of the given length, which need not be null terminated.
+// Windows line endings are normalized while reading.
+Agraph_t* rj_agmemread_buffer(const char* data, size_t length)
+{
+    rj_membuffer buffer = { data, length, 0 };
+    return agread(&buffer, &memDisc);
+}
+
+// Open a file for binary reading, given its UTF-8 encoded path
+static FILE* rj_fopen(const char* path)
+{
+#ifdef _WIN32
+    int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+    if (length == 0)
+        return nullptr;
+    vector<wchar_t> widePath(length);
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath.data(), length);
+    return _wfopen(widePath.data(), L"rb");
+#else
+    return fopen(path, "rb");
+#endif
+}
+
+// Read a graph from the file with the given UTF-8 encoded path, without loading the whole file in memory.
+// Windows line endings are normalized while reading, and a UTF-8 byte order mark is skipped.
+// Returns null if the file could not be opened or parsed.
+Agraph_t* rj_agread_file(const char* path)
+{
+    FILE* file = rj_fopen(path);
+    if (!file)
+        return nullptr;
+
+    // Cgraph asks for small chunks at a time, so read ahead in large ones
+    vector<char> readBuffer(1 << 20);
+    setvbuf(file, readBuffer.data(), _IOFBF, readBuffer.size());
+
+    unsigned char bom[3];
+    if (fread(bom, 1, 3, file) != 3 || bom[0] != 0xEF || bom[1] != 0xBB || bom[2] != 0xBF)
+        rewind(file);
+
+    Agraph_t* g = agread(file, &fileDisc);
+    fclose(file);
+    return g;
+}
+
 // Note: for this function to work, the graph has to be created with the disc, e.g. using rj_agopen
 // This function transfers ownership of the string result.
 // The caller has to call free_str to free it.
@@ -45,6 +103,181 @@ const char* rj_agmemwrite(Agraph_t* g)
     return STRDUP(os.str().c_str());
 }
 
+// A streambuf that writes directly into a growing malloc'd buffer, such that the output
+// can be handed to the caller without copying it once more, like rj_agmemwrite does.
+class rj_malloc_streambuf : public streambuf
+{
+public:
+    ~rj_malloc_streambuf() override
+    {
+        free(buffer);
+    }
+
+    bool failed = false;
+
+    // This function transfers ownership of the result. The caller has to call free_str to free it.
+    char* release(size_t* length)
+    {
+        *length = pptr() - pbase();
+        char* result = buffer;
+        buffer = nullptr;
+        setp(nullptr, nullptr);
+        return result;
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        if (!grow())
+            return traits_type::eof();
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+private:
+    bool grow()
+    {
+        size_t used = pptr() - pbase();
+        size_t capacity = used == 0 ? 1 << 16 : 2 * (size_t)(epptr() - pbase());
+        char* grown = (char*)realloc(buffer, capacity);
+        if (!grown)
+        {
+            failed = true;
+            return false;
+        }
+        buffer = grown;
+        // setp takes no offset, and pbump only takes an int, so advance in steps for outputs beyond 2 GB
+        setp(buffer, buffer + capacity);
+        for (size_t left = used; left > 0;)
+        {
+            int step = left > INT_MAX ? INT_MAX : (int)left;
+            pbump(step);
+            left -= step;
+        }
+        return true;
+    }
+
+    char* buffer = nullptr;
+};
+
+// Write the graph into a single buffer, whose length is stored in length. The same note as for rj_agmemwrite applies.
+// This function transfers ownership of the result. The caller has to call free_str to free it.
+// Returns null if agwrite failed or the buffer could not be allocated.
+char* rj_agwrite_buffer(Agraph_t* g, size_t* length)
+{
+    rj_malloc_streambuf buffer;
+    ostream os(&buffer);
+    int result = agwrite(g, &os);
+    os.flush();
+    *length = 0;
+    if (result != 0 || buffer.failed || !os)
+        return nullptr;
+    char* data = buffer.release(length);
+    // An empty output still needs a buffer, to distinguish it from failure
+    return data ? data : (char*)malloc(1);
+}
+
+// A streambuf that writes into a list of fixed size chunks. Unlike rj_malloc_streambuf it never
+// reallocates, so the output is never copied and never held twice while it is written.
+class rj_chunk_streambuf : public streambuf
+{
+public:
+    static const size_t chunk_size = 1 << 16;
+
+    ~rj_chunk_streambuf() override
+    {
+        while (first)
+            first = rj_free_chunk(first);
+    }
+
+    bool failed = false;
+
+    // This function transfers ownership of the chunks. The caller has to free them with rj_free_chunk.
+    rj_chunk* release()
+    {
+        finish_chunk();
+        rj_chunk* result = first;
+        first = last = nullptr;
+        setp(nullptr, nullptr);
+        return result;
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        if (!add_chunk())
+            return traits_type::eof();
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+private:
+    void finish_chunk()
+    {
+        if (last)
+            last->length = pptr() - pbase();
+    }
+
+    bool add_chunk()
+    {
+        finish_chunk();
+        rj_chunk* chunk = (rj_chunk*)malloc(sizeof(rj_chunk) + chunk_size);
+        if (!chunk)
+        {
+            failed = true;
+            return false;
+        }
+        chunk->next = nullptr;
+        chunk->length = 0;
+        chunk->data = (char*)(chunk + 1);
+        if (last)
+            last->next = chunk;
+        else
+            first = chunk;
+        last = chunk;
+        setp(chunk->data, chunk->data + chunk_size);
+        return true;
+    }
+
+    rj_chunk* first = nullptr;
+    rj_chunk* last = nullptr;
+};
+
+// Write the graph into a list of chunks of at most 64 KB. The same note as for rj_agmemwrite applies.
+// This function transfers ownership of the chunks. The caller has to free every chunk with rj_free_chunk.
+// Returns null if agwrite failed or a chunk could not be allocated.
+rj_chunk* rj_agwrite_chunks(Agraph_t* g)
+{
+    rj_chunk_streambuf buffer;
+    ostream os(&buffer);
+    int result = agwrite(g, &os);
+    os.flush();
+    if (result != 0 || buffer.failed || !os)
+        return nullptr;
+    rj_chunk* first = buffer.release();
+    // An empty output still needs a chunk, to distinguish it from failure
+    return first ? first : (rj_chunk*)calloc(1, sizeof(rj_chunk));
+}
+
+const char* rj_chunk_data(rj_chunk* chunk, size_t* length)
+{
+    *length = chunk->length;
+    return chunk->data;
+}
+
+// Free the chunk and return the next one, or null if it was the last
+rj_chunk* rj_free_chunk(rj_chunk* chunk)
+{
+    rj_chunk* next = chunk->next;
+    free(chunk);
+    return next;
+}
 
 // Expose removed cgraph functions https://gitlab.com/graphviz/graphviz/-/issues/2433
 // When new GraphViz is released these are re-exposed and our wrappers can be removed
@@ -68,6 +301,12 @@ Agedge_t* rj_agmkout(Agedge_t* e)
 {
     return AGMKOUT(e);
 }
+// The id of a named object is the address of its name in the string dictionary, which is even.
+// Anonymous objects get odd ids, and only for those agnameof may print into its static buffer.
+int rj_agisanonymous(void* obj)
+{
+    return AGID(obj) % 2 == 1;
+}
 
 textlabel_t* node_label(Agnode_t* node) { return ND_label(node); }
 textlabel_t* edge_label(Agedge_t* edge) { return ED_label(edge); }
@@ -107,3 +346,1712 @@ void convert_to_undirected(Agraph_t* graph)
 {
     graph->desc.directed = 0;
 }
+
+// Visit the nodes of g, or the edges of g, in the same order as Graph.Nodes() and Graph.Edges().
+// Like Graph.Edges(), this visits the out edges of the nodes of g in the root graph.
+template <typename F>
+static void for_each_column_object(Agraph_t* g, bool edges, F f)
+{
+    Agraph_t* root = agroot(g);
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+    {
+        if (!edges)
+        {
+            f(n);
+            continue;
+        }
+        for (Agedge_t* e = agfstout(root, n); e; e = agnxtout(root, e))
+            f(e);
+    }
+}
+
+// Collects a list of strings in the column layout: the int32 number of values, followed by count + 1
+// int32 offsets into the UTF-8 data that follows. Value i consists of the bytes [offsets[i], offsets[i + 1]).
+struct column_builder
+{
+    vector<int> offsets;
+    string data;
+
+    void add(const char* value)
+    {
+        offsets.push_back((int)data.size());
+        if (value)
+            data += value;
+    }
+
+    // This function transfers ownership of the result. The caller has to call free_str to free it.
+    char* release()
+    {
+        offsets.push_back((int)data.size());
+        int count = (int)offsets.size() - 1;
+        size_t header = sizeof(int) * (offsets.size() + 1);
+        char* result = (char*)malloc(header + data.size());
+        if (!result)
+            return nullptr;
+        memcpy(result, &count, sizeof(int));
+        memcpy(result + sizeof(int), offsets.data(), sizeof(int) * offsets.size());
+        memcpy(result + header, data.data(), data.size());
+        return result;
+    }
+};
+
+static char* get_attribute_column(Agraph_t* g, Agsym_t* sym, bool edges)
+{
+    column_builder column;
+    for_each_column_object(g, edges, [&](void* obj) { column.add(agxget(obj, sym)); });
+    return column.release();
+}
+
+// The values are given as UTF-8 data without terminators, where value i consists of the bytes
+// [offsets[i], offsets[i + 1]) of the data. Returns the number of values that were set, or -1 if
+// count does not match the number of objects, in which case nothing is set.
+static int set_attribute_column(Agraph_t* g, Agsym_t* sym, bool edges, const char* data, const int* offsets, int count)
+{
+    int expected = 0;
+    for_each_column_object(g, edges, [&](void*) { expected++; });
+    if (expected != count)
+        return -1;
+
+    int i = 0;
+    string value;
+    for_each_column_object(g, edges, [&](void* obj) {
+        value.assign(data + offsets[i], data + offsets[i + 1]);
+        agxset(obj, sym, value.c_str());
+        i++;
+    });
+    return count;
+}
+
+char* get_node_attribute_column(Agraph_t* g, Agsym_t* sym) { return get_attribute_column(g, sym, false); }
+char* get_edge_attribute_column(Agraph_t* g, Agsym_t* sym) { return get_attribute_column(g, sym, true); }
+
+int set_node_attribute_column(Agraph_t* g, Agsym_t* sym, const char* data, const int* offsets, int count)
+{
+    return set_attribute_column(g, sym, false, data, offsets, count);
+}
+int set_edge_attribute_column(Agraph_t* g, Agsym_t* sym, const char* data, const int* offsets, int count)
+{
+    return set_attribute_column(g, sym, true, data, offsets, count);
+}
+
+// Copies the attribute values of src onto dst, where syms holds pairs of corresponding symbols
+// of the source and target graphs. Like agcopyattr, the key of an edge is not copied.
+static void copy_attribute_values(void* src, void* dst, const vector<pair<Agsym_t*, Agsym_t*>>& syms)
+{
+    for (const auto& sym : syms)
+    {
+        const char* value = agxget(src, sym.first);
+        if (strcmp(value, agxget(dst, sym.second)) != 0)
+            agxset(dst, sym.second, value);
+    }
+}
+
+struct clone_state
+{
+    vector<pair<Agsym_t*, Agsym_t*>> syms[3];
+    unordered_map<Agnode_t*, Agnode_t*> nodes;
+    unordered_map<Agedge_t*, Agedge_t*> edges;
+    // When set, only the nodes that are labeled with the given component are cloned
+    const unordered_map<Agnode_t*, int>* components = nullptr;
+    int component = 0;
+
+    bool includes(Agnode_t* n) const
+    {
+        return !components || components->at(n) == component;
+    }
+};
+
+static void clone_subgraphs(Agraph_t* from, Agraph_t* to, clone_state& state)
+{
+    for (Agraph_t* sub = agfstsubg(from); sub; sub = agnxtsubg(sub))
+    {
+        // The nodes of a subgraph always end up in the same component
+        Agnode_t* first = agfstnode(sub);
+        if (state.components && (!first || !state.includes(first)))
+            continue;
+
+        Agraph_t* newsub = agsubg(to, agnameof(sub), 1);
+        copy_attribute_values(sub, newsub, state.syms[AGRAPH]);
+        for (Agnode_t* n = first; n; n = agnxtnode(sub, n))
+        {
+            agsubnode(newsub, state.nodes[n], 1);
+            for (Agedge_t* e = agfstout(sub, n); e; e = agnxtout(sub, e))
+            {
+                auto newedge = state.edges.find(AGMKOUT(e));
+                if (newedge != state.edges.end())
+                    agsubedge(newsub, newedge->second, 1);
+            }
+        }
+        clone_subgraphs(sub, newsub, state);
+    }
+}
+
+static void clone_into(Agraph_t* from, Agraph_t* target, clone_state& state)
+{
+    Agraph_t* root = agroot(from);
+    if (root != target)
+        clone_attribute_declarations(root, target);
+    for (int kind = 0; kind < 3; kind++)
+    {
+        for (Agsym_t* sym = agnxtattr(root, kind, nullptr); sym; sym = agnxtattr(root, kind, sym))
+        {
+            if (kind == AGEDGE && strcmp(sym->name, "key") == 0)
+                continue;
+            state.syms[kind].emplace_back(sym, agattr(target, kind, sym->name, nullptr));
+        }
+    }
+
+    // Nodes and edges are created in a single pass, so a node may be created as the head of an edge
+    // before it is visited itself. This mirrors the order in which Graph.CloneInto used to create them.
+    auto clone_node = [&](Agnode_t* n) {
+        Agnode_t*& newnode = state.nodes[n];
+        if (!newnode)
+            newnode = agnode(target, agnameof(n), 1);
+        return newnode;
+    };
+    for (Agnode_t* n = agfstnode(from); n; n = agnxtnode(from, n))
+    {
+        if (!state.includes(n))
+            continue;
+        Agnode_t* newtail = clone_node(n);
+        for (Agedge_t* e = agfstout(from, n); e; e = agnxtout(from, e))
+        {
+            Agnode_t* newhead = clone_node(aghead(e));
+            const char* name = agnameof(e);
+            Agedge_t* newedge = agedge(target, newtail, newhead, name && *name ? const_cast<char*>(name) : nullptr, 1);
+            if (!newedge)
+                continue;
+            state.edges[AGMKOUT(e)] = newedge;
+            copy_attribute_values(e, newedge, state.syms[AGEDGE]);
+        }
+        copy_attribute_values(n, newtail, state.syms[AGNODE]);
+    }
+
+    clone_subgraphs(from, target, state);
+}
+
+void rj_clone_into(Agraph_t* from, Agraph_t* target)
+{
+    clone_state state;
+    clone_into(from, target, state);
+}
+
+// Create a new root graph with the same type as g, and copy the graph attributes of g
+static Agraph_t* open_like(Agraph_t* g, const char* name)
+{
+    Agraph_t* result = agopen(const_cast<char*>(name), agroot(g)->desc, &disc);
+    if (!result)
+        return nullptr;
+    clone_attribute_declarations(agroot(g), result);
+    Agsym_t* sym = nullptr;
+    while ((sym = agnxtattr(g, AGRAPH, sym)))
+        agxset(result, agattr(result, AGRAPH, sym->name, nullptr), agxget(g, sym));
+    return result;
+}
+
+Agraph_t* rj_clone_graph(Agraph_t* g, const char* name)
+{
+    Agraph_t* result = open_like(g, name);
+    if (result)
+        rj_clone_into(g, result);
+    return result;
+}
+
+// A new root graph from a table of strings, which holds the node names, then the edge names, and then for every
+// attribute its name, its default and its values, one for each node or edge depending on the kind of the attribute.
+// Edge i goes from node tails[i] to node heads[i], and has the edge name with index edge_names[i], or no name if
+// that is negative. Attribute kinds are 1 for nodes and 2 for edges.
+Agraph_t* rj_build_graph(const char* name, int graphtype, const char* strings, const int* offsets,
+    int node_count, int edge_name_count, const int* tails, const int* heads, const int* edge_names, int edge_count,
+    const int* attribute_kinds, int attribute_count)
+{
+    Agraph_t* g = rj_agopen(const_cast<char*>(name), graphtype);
+    if (!g)
+        return nullptr;
+    int next = 0;
+    auto next_string = [&]() { string s(strings + offsets[next], strings + offsets[next + 1]); ++next; return s; };
+
+    vector<Agnode_t*> nodes(node_count);
+    for (int i = 0; i < node_count; ++i)
+        nodes[i] = agnode(g, const_cast<char*>(next_string().c_str()), 1);
+
+    vector<string> names;
+    names.reserve(edge_name_count);
+    for (int i = 0; i < edge_name_count; ++i)
+        names.push_back(next_string());
+
+    // In strict graphs, edges may be merged, or refused if they are loops
+    vector<Agedge_t*> edges(edge_count);
+    for (int i = 0; i < edge_count; ++i)
+    {
+        char* edge_name = edge_names[i] < 0 ? nullptr : const_cast<char*>(names[edge_names[i]].c_str());
+        edges[i] = agedge(g, nodes[tails[i]], nodes[heads[i]], edge_name, 1);
+    }
+
+    for (int a = 0; a < attribute_count; ++a)
+    {
+        int kind = attribute_kinds[a] == 1 ? AGNODE : AGEDGE;
+        string attribute = next_string();
+        string deflt = next_string();
+        // Always declare the default, since the graph may already inherit the attribute from the ProtoGraph
+        Agsym_t* sym = agattr(g, kind, const_cast<char*>(attribute.c_str()), deflt.c_str());
+        int count = kind == AGNODE ? node_count : edge_count;
+        for (int i = 0; i < count; ++i)
+        {
+            string value = next_string();
+            void* obj = kind == AGNODE ? static_cast<void*>(nodes[i]) : static_cast<void*>(edges[i]);
+            if (obj)
+                agxset(obj, sym, value.c_str());
+        }
+    }
+    return g;
+}
+
+// The binary snapshot format. All integers are int32 in little endian byte order:
+//   "RJGS", version, flags (1 = directed, 2 = strict)
+//   the number of strings, and for every string its length in bytes followed by its UTF-8 data.
+//     Bit 31 of the length marks HTML-like strings.
+//   the number of int32 words that follow, which are:
+//   - the index of the name of the graph
+//   - the number of nodes, and for every node the index of its name
+//   - the number of edges, and for every edge its tail, its head, and the index of its name or -1 if it has none
+//   - the number of subgraphs, and for every subgraph in pre-order the index of its name, the index of its parent
+//     or -1 for the graph itself, and bitmaps of the nodes and of the edges that it contains
+//   - for graphs, nodes and edges: the number of attributes, and for every attribute the index of its name,
+//     of its default, and of its value for every graph, node or edge. The graphs are the graph itself followed
+//     by its subgraphs.
+// Strings are stored only once, so repetitive attribute values take a single word per object.
+static const char snapshot_magic[4] = { 'R', 'J', 'G', 'S' };
+static const int snapshot_version = 1;
+static const unsigned snapshot_html_flag = 0x80000000u;
+
+struct snapshot_writer
+{
+    unordered_map<string, int> indices;
+    vector<pair<string, bool>> strings;
+    vector<int> words;
+
+    // Names are interned as plain text, since agnameof may return a temporary buffer instead of a refstr
+    int intern_name(const char* name) { return intern(name, false); }
+    int intern_value(const char* value) { return intern(value, value && aghtmlstr(const_cast<char*>(value))); }
+
+    int intern(const char* value, bool html)
+    {
+        if (!value)
+            return -1;
+        // HTML-like strings and ordinary strings with the same text are different values
+        string key = (html ? '<' : '"') + string(value);
+        auto found = indices.find(key);
+        if (found != indices.end())
+            return found->second;
+        int index = (int)strings.size();
+        indices.emplace(move(key), index);
+        strings.emplace_back(value, html);
+        return index;
+    }
+
+    void add(int word) { words.push_back(word); }
+
+    // The bits are set directly in the words of the snapshot
+    void add_bitmap(const vector<int>& members, size_t count)
+    {
+        size_t start = words.size();
+        words.resize(start + (count + 31) / 32);
+        for (int i : members)
+            words[start + i / 32] |= (int)(1u << (i % 32));
+    }
+
+    // Writes the snapshot into a single buffer of exactly the right size.
+    // This function transfers ownership of the result. The caller has to call free_str to free it.
+    char* release(int flags, int* length)
+    {
+        *length = 0;
+        size_t size = sizeof(snapshot_magic) + 4 * (4 + strings.size() + words.size());
+        for (const auto& s : strings)
+            size += s.first.size();
+        if (size > (size_t)INT_MAX)
+            return nullptr;
+        char* result = (char*)malloc(size);
+        if (!result)
+            return nullptr;
+
+        char* p = result;
+        auto put = [&](int value) {
+            unsigned u = (unsigned)value;
+            *p++ = (char)(u & 0xFF);
+            *p++ = (char)((u >> 8) & 0xFF);
+            *p++ = (char)((u >> 16) & 0xFF);
+            *p++ = (char)(u >> 24);
+        };
+        memcpy(p, snapshot_magic, sizeof(snapshot_magic));
+        p += sizeof(snapshot_magic);
+        put(snapshot_version);
+        put(flags);
+        put((int)strings.size());
+        for (const auto& s : strings)
+        {
+            put((int)(s.first.size() | (s.second ? snapshot_html_flag : 0)));
+            memcpy(p, s.first.data(), s.first.size());
+            p += s.first.size();
+        }
+        put((int)words.size());
+        for (int w : words)
+            put(w);
+        *length = (int)size;
+        return result;
+    }
+};
+
+static void collect_subgraphs(Agraph_t* g, vector<pair<Agraph_t*, int>>& subgraphs, int parent)
+{
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+    {
+        subgraphs.emplace_back(sub, parent);
+        collect_subgraphs(sub, subgraphs, (int)subgraphs.size() - 1);
+    }
+}
+
+// Write the nodes, edges, subgraphs and attribute values of g into a buffer, or return null if it does not fit.
+// This function transfers ownership of the result. The caller has to call free_str to free it.
+char* rj_write_snapshot(Agraph_t* g, int* length)
+{
+    Agraph_t* root = agroot(g);
+    snapshot_writer writer;
+    writer.add(writer.intern_name(agnameof(g)));
+
+    vector<Agnode_t*> nodes;
+    unordered_map<Agnode_t*, int> node_indices;
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+    {
+        node_indices.emplace(n, (int)nodes.size());
+        nodes.push_back(n);
+    }
+    writer.add((int)nodes.size());
+    for (Agnode_t* n : nodes)
+        writer.add(writer.intern_name(agnameof(n)));
+
+    vector<Agedge_t*> edges;
+    unordered_map<Agedge_t*, int> edge_indices;
+    for (Agnode_t* n : nodes)
+    {
+        for (Agedge_t* e = agfstout(g, n); e; e = agnxtout(g, e))
+        {
+            edge_indices.emplace(AGMKOUT(e), (int)edges.size());
+            edges.push_back(e);
+        }
+    }
+    writer.add((int)edges.size());
+    for (Agedge_t* e : edges)
+    {
+        writer.add(node_indices[agtail(e)]);
+        writer.add(node_indices[aghead(e)]);
+        const char* name = agnameof(e);
+        writer.add(name && *name ? writer.intern_name(name) : -1);
+    }
+
+    vector<pair<Agraph_t*, int>> subgraphs;
+    collect_subgraphs(g, subgraphs, -1);
+    writer.add((int)subgraphs.size());
+    vector<int> members;
+    for (const auto& sub : subgraphs)
+    {
+        writer.add(writer.intern_name(agnameof(sub.first)));
+        writer.add(sub.second);
+        members.clear();
+        for (Agnode_t* n = agfstnode(sub.first); n; n = agnxtnode(sub.first, n))
+            members.push_back(node_indices[n]);
+        writer.add_bitmap(members, nodes.size());
+        members.clear();
+        for (Agnode_t* n = agfstnode(sub.first); n; n = agnxtnode(sub.first, n))
+            for (Agedge_t* e = agfstout(sub.first, n); e; e = agnxtout(sub.first, e))
+                members.push_back(edge_indices[AGMKOUT(e)]);
+        writer.add_bitmap(members, edges.size());
+    }
+
+    for (int kind = 0; kind < 3; kind++)
+    {
+        // Like rj_clone_into, the key of an edge is not stored, since it is the name of the edge
+        vector<Agsym_t*> syms;
+        for (Agsym_t* sym = agnxtattr(root, kind, nullptr); sym; sym = agnxtattr(root, kind, sym))
+            if (kind != AGEDGE || strcmp(sym->name, "key") != 0)
+                syms.push_back(sym);
+        writer.add((int)syms.size());
+        for (Agsym_t* sym : syms)
+        {
+            writer.add(writer.intern_name(sym->name));
+            writer.add(writer.intern_value(sym->defval));
+            if (kind == AGRAPH)
+            {
+                writer.add(writer.intern_value(agxget(g, sym)));
+                for (const auto& sub : subgraphs)
+                    writer.add(writer.intern_value(agxget(sub.first, sym)));
+            }
+            else if (kind == AGNODE)
+            {
+                for (Agnode_t* n : nodes)
+                    writer.add(writer.intern_value(agxget(n, sym)));
+            }
+            else
+            {
+                for (Agedge_t* e : edges)
+                    writer.add(writer.intern_value(agxget(e, sym)));
+            }
+        }
+    }
+
+    int flags = (agisdirected(root) ? 1 : 0) | (agisstrict(root) ? 2 : 0);
+    return writer.release(flags, length);
+}
+
+// Reads a snapshot, keeping track of whether it is well-formed. Reading past the end, or a string index
+// that is out of range, marks the snapshot as invalid.
+struct snapshot_reader
+{
+    const unsigned char* data;
+    size_t length;
+    size_t position = 0;
+    bool valid = true;
+    // The offset and the length of every string, which are only copied out of the data when they are used
+    vector<pair<size_t, size_t>> strings;
+    vector<bool> html;
+
+    snapshot_reader(const char* data, int length) : data((const unsigned char*)data), length(length < 0 ? 0 : length) {}
+
+    unsigned next_unsigned()
+    {
+        if (length - position < 4)
+        {
+            valid = false;
+            position = length;
+            return 0;
+        }
+        const unsigned char* p = data + position;
+        position += 4;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+    }
+
+    int next() { return (int)next_unsigned(); }
+
+    // The number of elements that follow, each of which takes at least the given number of bytes
+    int next_count(size_t element_size)
+    {
+        int count = next();
+        if (count < 0 || (size_t)count > (length - position) / element_size)
+        {
+            valid = false;
+            return 0;
+        }
+        return count;
+    }
+
+    // Returns the index of a string, or -1 if the snapshot is invalid
+    int next_string(bool optional = false)
+    {
+        int index = next();
+        if (optional && index == -1)
+            return -1;
+        if (index < 0 || index >= (int)strings.size())
+        {
+            valid = false;
+            return -1;
+        }
+        return index;
+    }
+
+    int next_index(int count)
+    {
+        int index = next();
+        if (index < 0 || index >= count)
+        {
+            valid = false;
+            return -1;
+        }
+        return index;
+    }
+
+    vector<int> next_bitmap(int count)
+    {
+        vector<int> members;
+        int words = (count + 31) / 32;
+        for (int w = 0; w < words && valid; w++)
+        {
+            unsigned bits = next_unsigned();
+            for (int b = 0; b < 32; b++)
+                if (bits & (1u << b) && w * 32 + b < count)
+                    members.push_back(w * 32 + b);
+        }
+        return members;
+    }
+
+    string text(int i) const
+    {
+        return string((const char*)data + strings[i].first, strings[i].second);
+    }
+
+    bool read_header(int* flags)
+    {
+        if (length < sizeof(snapshot_magic) || memcmp(data, snapshot_magic, sizeof(snapshot_magic)) != 0)
+            return false;
+        position = sizeof(snapshot_magic);
+        if (next() != snapshot_version)
+            return false;
+        *flags = next();
+        int count = next_count(4);
+        strings.reserve(count);
+        html.reserve(count);
+        for (int i = 0; i < count && valid; i++)
+        {
+            unsigned size = next_unsigned();
+            bool is_html = (size & snapshot_html_flag) != 0;
+            size &= ~snapshot_html_flag;
+            if (size > length - position)
+                return valid = false;
+            strings.emplace_back(position, size);
+            html.push_back(is_html);
+            position += size;
+        }
+        // The number of words, which must be exactly what remains
+        int words = next();
+        return valid && words >= 0 && (size_t)words * 4 == length - position;
+    }
+};
+
+// Set the value of obj to string i of the snapshot, keeping HTML-like strings intact
+static void set_snapshot_value(Agraph_t* root, void* obj, Agsym_t* sym, const snapshot_reader& reader, int i)
+{
+    string text = reader.text(i);
+    if (!reader.html[i])
+    {
+        agxset(obj, sym, text.c_str());
+        return;
+    }
+    char* value = agstrdup_html(root, const_cast<char*>(text.c_str()));
+    agxset(obj, sym, value);
+    agstrfree(root, value);
+}
+
+// Declare the attribute with the stored default. This always declares the default, since the new graph may
+// already have the attribute through the ProtoGraph, with a different default.
+static Agsym_t* declare_snapshot_attribute(Agraph_t* g, int kind, const snapshot_reader& reader, int name, int deflt)
+{
+    string attribute = reader.text(name);
+    string text = reader.text(deflt);
+    if (!reader.html[deflt])
+        return agattr(g, kind, const_cast<char*>(attribute.c_str()), text.c_str());
+    char* value = agstrdup_html(g, const_cast<char*>(text.c_str()));
+    Agsym_t* sym = agattr(g, kind, const_cast<char*>(attribute.c_str()), value);
+    agstrfree(g, value);
+    return sym;
+}
+
+// A new root graph from a snapshot written by rj_write_snapshot, or null if the data is not a valid snapshot
+Agraph_t* rj_read_snapshot(const char* data, int length)
+{
+    snapshot_reader reader(data, length);
+    int flags = 0;
+    if (!reader.read_header(&flags))
+        return nullptr;
+    int name = reader.next_string();
+    if (!reader.valid)
+        return nullptr;
+    Agraph_t* g = rj_agopen(const_cast<char*>(reader.text(name).c_str()), ((flags & 1) ? 0 : 2) + ((flags & 2) ? 1 : 0));
+    if (!g)
+        return nullptr;
+
+    vector<Agnode_t*> nodes(reader.next_count(4));
+    for (size_t i = 0; i < nodes.size() && reader.valid; i++)
+    {
+        int node_name = reader.next_string();
+        if (reader.valid)
+            nodes[i] = agnode(g, const_cast<char*>(reader.text(node_name).c_str()), 1);
+    }
+
+    vector<Agedge_t*> edges(reader.next_count(12));
+    for (size_t i = 0; i < edges.size() && reader.valid; i++)
+    {
+        int tail = reader.next_index((int)nodes.size());
+        int head = reader.next_index((int)nodes.size());
+        int edge_name = reader.next_string(true);
+        if (!reader.valid)
+            break;
+        string text = edge_name < 0 ? string() : reader.text(edge_name);
+        edges[i] = agedge(g, nodes[tail], nodes[head], edge_name < 0 ? nullptr : const_cast<char*>(text.c_str()), 1);
+    }
+
+    vector<Agraph_t*> subgraphs(reader.next_count(8));
+    for (size_t i = 0; i < subgraphs.size() && reader.valid; i++)
+    {
+        int sub_name = reader.next_string();
+        int parent = reader.next();
+        if (parent < -1 || parent >= (int)i)
+            reader.valid = false;
+        if (!reader.valid)
+            break;
+        Agraph_t* sub = agsubg(parent < 0 ? g : subgraphs[parent], const_cast<char*>(reader.text(sub_name).c_str()), 1);
+        subgraphs[i] = sub;
+        for (int n : reader.next_bitmap((int)nodes.size()))
+            agsubnode(sub, nodes[n], 1);
+        for (int e : reader.next_bitmap((int)edges.size()))
+            if (edges[e])
+                agsubedge(sub, edges[e], 1);
+    }
+
+    for (int kind = 0; kind < 3 && reader.valid; kind++)
+    {
+        int attribute_count = reader.next_count(8);
+        for (int a = 0; a < attribute_count && reader.valid; a++)
+        {
+            int attribute = reader.next_string();
+            int deflt = reader.next_string();
+            if (!reader.valid)
+                break;
+            Agsym_t* sym = declare_snapshot_attribute(g, kind, reader, attribute, deflt);
+
+            size_t count = kind == AGRAPH ? subgraphs.size() + 1 : kind == AGNODE ? nodes.size() : edges.size();
+            for (size_t i = 0; i < count && reader.valid; i++)
+            {
+                int value = reader.next_string();
+                void* obj = kind == AGRAPH ? (i == 0 ? static_cast<void*>(g) : static_cast<void*>(subgraphs[i - 1]))
+                    : kind == AGNODE ? static_cast<void*>(nodes[i]) : static_cast<void*>(edges[i]);
+                if (reader.valid && obj)
+                    set_snapshot_value(g, obj, sym, reader, value);
+            }
+        }
+    }
+
+    if (!reader.valid || reader.position != reader.length)
+    {
+        agclose(g);
+        return nullptr;
+    }
+    return g;
+}
+
+static string name_of(void* obj)
+{
+    const char* name = agnameof(obj);
+    return name ? name : "";
+}
+
+// The out edges of a single node, indexed by name and head
+struct out_edge_index
+{
+    struct entry
+    {
+        string name;
+        string head;
+        string key;
+        Agedge_t* edge;
+    };
+    vector<entry> edges;
+    unordered_map<string, Agedge_t*> by_key;
+    unordered_set<string> names;
+
+    void build(Agraph_t* g, Agnode_t* n)
+    {
+        edges.clear();
+        by_key.clear();
+        names.clear();
+        for (Agedge_t* e = agfstout(g, n); e; e = agnxtout(g, e))
+        {
+            entry item{ name_of(e), name_of(aghead(e)), "", e };
+            item.key = item.name + '\0' + item.head;
+            by_key.emplace(item.key, e);
+            if (!item.name.empty())
+                names.insert(item.name);
+            edges.push_back(move(item));
+        }
+    }
+};
+
+struct compared_attribute
+{
+    string name;
+    Agsym_t* a;
+    Agsym_t* b;
+};
+
+// The union of the attributes of the given kind that are declared in the root graphs of a and b
+static vector<compared_attribute> compared_attributes(Agraph_t* a, Agraph_t* b, int kind)
+{
+    Agraph_t* roota = agroot(a);
+    Agraph_t* rootb = agroot(b);
+    vector<compared_attribute> result;
+    for (Agsym_t* sym = agnxtattr(roota, kind, nullptr); sym; sym = agnxtattr(roota, kind, sym))
+    {
+        // The key of an edge is its name, which is compared already
+        if (kind == AGEDGE && strcmp(sym->name, "key") == 0)
+            continue;
+        result.push_back({ sym->name, sym, agattr(rootb, kind, sym->name, nullptr) });
+    }
+    for (Agsym_t* sym = agnxtattr(rootb, kind, nullptr); sym; sym = agnxtattr(rootb, kind, sym))
+    {
+        if (kind == AGEDGE && strcmp(sym->name, "key") == 0)
+            continue;
+        if (!agattr(roota, kind, sym->name, nullptr))
+            result.push_back({ sym->name, nullptr, sym });
+    }
+    return result;
+}
+
+// Each difference consists of eight values: the kind of the difference, the graph that lacks
+// something ("A" or "B"), the node or tail, the head, the edge name, the attribute name, and the
+// attribute values in A and B. Values that do not apply to the kind of difference are empty.
+struct graph_diff
+{
+    enum kind { missing_node = 0, missing_edge = 1, endpoint_mismatch = 2, attribute_mismatch = 3 };
+
+    column_builder column;
+
+    void add(kind k, const char* graph, const string& node, const string& head, const string& edge,
+        const string& attribute = "", const char* a = "", const char* b = "")
+    {
+        column.add(to_string((int)k).c_str());
+        column.add(graph);
+        column.add(node.c_str());
+        column.add(head.c_str());
+        column.add(edge.c_str());
+        column.add(attribute.c_str());
+        column.add(a);
+        column.add(b);
+    }
+
+    void compare_attributes(void* a, void* b, const vector<compared_attribute>& attributes,
+        const string& node, const string& head, const string& edge)
+    {
+        for (const auto& attribute : attributes)
+        {
+            const char* va = attribute.a ? agxget(a, attribute.a) : "";
+            const char* vb = attribute.b ? agxget(b, attribute.b) : "";
+            if (strcmp(va, vb) != 0)
+                add(attribute_mismatch, "", node, head, edge, attribute.name, va, vb);
+        }
+    }
+
+    // Report the edges of from that do not occur in to. Parallel edges with the same name and head
+    // are considered equal, so they are only reported once.
+    void compare_edges(const out_edge_index& from, const out_edge_index& to, const char* graph, const string& tail)
+    {
+        for (const auto& item : from.edges)
+        {
+            if (to.by_key.count(item.key) || from.by_key.at(item.key) != item.edge)
+                continue;
+            kind k = !item.name.empty() && to.names.count(item.name) ? endpoint_mismatch : missing_edge;
+            add(k, graph, tail, item.head, item.name);
+        }
+    }
+};
+
+char* rj_compare_graphs(Agraph_t* a, Agraph_t* b, int compare_attributes)
+{
+    graph_diff diff;
+    unordered_map<string, Agnode_t*> nodesa;
+    unordered_map<string, Agnode_t*> nodesb;
+    vector<pair<Agnode_t*, Agnode_t*>> common;
+    for (Agnode_t* n = agfstnode(b); n; n = agnxtnode(b, n))
+        nodesb.emplace(name_of(n), n);
+    for (Agnode_t* n = agfstnode(a); n; n = agnxtnode(a, n))
+    {
+        string name = name_of(n);
+        nodesa.emplace(name, n);
+        auto other = nodesb.find(name);
+        if (other == nodesb.end())
+            diff.add(graph_diff::missing_node, "B", name, "", "");
+        else
+            common.emplace_back(n, other->second);
+    }
+    for (Agnode_t* n = agfstnode(b); n; n = agnxtnode(b, n))
+    {
+        string name = name_of(n);
+        if (!nodesa.count(name))
+            diff.add(graph_diff::missing_node, "A", name, "", "");
+    }
+
+    vector<compared_attribute> node_attributes;
+    vector<compared_attribute> edge_attributes;
+    if (compare_attributes)
+    {
+        diff.compare_attributes(a, b, compared_attributes(a, b, AGRAPH), "", "", "");
+        node_attributes = compared_attributes(a, b, AGNODE);
+        edge_attributes = compared_attributes(a, b, AGEDGE);
+    }
+
+    out_edge_index edgesa;
+    out_edge_index edgesb;
+    for (const auto& nodes : common)
+    {
+        string tail = name_of(nodes.first);
+        edgesa.build(a, nodes.first);
+        edgesb.build(b, nodes.second);
+        diff.compare_edges(edgesa, edgesb, "B", tail);
+        diff.compare_edges(edgesb, edgesa, "A", tail);
+        if (!compare_attributes)
+            continue;
+
+        diff.compare_attributes(nodes.first, nodes.second, node_attributes, tail, "", "");
+        for (const auto& item : edgesa.edges)
+        {
+            auto other = edgesb.by_key.find(item.key);
+            if (other != edgesb.by_key.end() && edgesa.by_key.at(item.key) == item.edge)
+                diff.compare_attributes(item.edge, other->second, edge_attributes, tail, item.head, item.name);
+        }
+    }
+    return diff.column.release();
+}
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3_x64_128 by Austin Appleby, with a seed of zero.
+// Blocks are read as little endian, such that the result does not depend on the platform.
+static void murmur3_128(const string& data, uint64_t out[2])
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    const unsigned char* bytes = (const unsigned char*)data.data();
+    const size_t length = data.size();
+    auto read64 = [](const unsigned char* p) {
+        uint64_t result = 0;
+        for (int i = 7; i >= 0; i--)
+            result = (result << 8) | p[i];
+        return result;
+    };
+
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    size_t nblocks = length / 16;
+    for (size_t i = 0; i < nblocks; i++)
+    {
+        uint64_t k1 = read64(bytes + i * 16);
+        uint64_t k2 = read64(bytes + i * 16 + 8);
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const unsigned char* tail = bytes + nblocks * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+    size_t rest = length & 15;
+    for (size_t i = rest; i > 8; i--)
+        k2 = (k2 << 8) | tail[i - 1];
+    for (size_t i = rest < 8 ? rest : 8; i > 0; i--)
+        k1 = (k1 << 8) | tail[i - 1];
+    if (rest > 8)
+    {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if (rest > 0)
+    {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+// Order independent hash of a multiset of elements. Every element is serialized with length prefixed
+// fields, hashed on its own, and the element hashes are summed, such that the result does not depend
+// on the order in which the elements are visited.
+struct fingerprint_builder
+{
+    string element;
+    uint64_t sum[2] = { 0, 0 };
+    uint64_t count = 0;
+
+    void begin(char tag)
+    {
+        element.assign(1, tag);
+    }
+
+    void field(const char* value)
+    {
+        uint32_t length = value ? (uint32_t)strlen(value) : 0;
+        for (int i = 0; i < 4; i++)
+            element += (char)((length >> (8 * i)) & 0xff);
+        if (value)
+            element.append(value, length);
+    }
+
+    void attributes(void* obj, const vector<pair<string, Agsym_t*>>& syms)
+    {
+        for (const auto& sym : syms)
+        {
+            field(sym.first.c_str());
+            field(sym.second ? agxget(obj, sym.second) : "");
+        }
+    }
+
+    void end()
+    {
+        uint64_t hash[2];
+        murmur3_128(element, hash);
+        sum[0] += hash[0];
+        sum[1] += hash[1];
+        count++;
+    }
+};
+
+// Add the endpoints and the name of an edge. The endpoints of undirected edges are sorted, because
+// a -- b and b -- a denote the same edge.
+static void fingerprint_edge(fingerprint_builder& fingerprint, Agedge_t* e, bool directed)
+{
+    string tail = name_of(agtail(e));
+    string head = name_of(aghead(e));
+    if (!directed && head < tail)
+        swap(tail, head);
+    fingerprint.field(tail.c_str());
+    fingerprint.field(head.c_str());
+    fingerprint.field(name_of(e).c_str());
+}
+
+// The name of a named subgraph. Anonymous subgraphs, like the { rank=same; ... } blocks of DOT, are named after
+// an id from a process wide counter, so they are identified by their content instead: the key of their parent,
+// their attributes, and their sorted nodes and edges.
+static string subgraph_key(Agraph_t* sub, const string& parent, bool directed,
+    const vector<pair<string, Agsym_t*>>& graph_syms)
+{
+    if (!rj_agisanonymous(sub))
+        return name_of(sub);
+
+    vector<string> nodes;
+    vector<string> edges;
+    for (Agnode_t* n = agfstnode(sub); n; n = agnxtnode(sub, n))
+    {
+        nodes.push_back(name_of(n));
+        for (Agedge_t* e = agfstout(sub, n); e; e = agnxtout(sub, e))
+        {
+            fingerprint_builder edge;
+            edge.begin('e');
+            fingerprint_edge(edge, e, directed);
+            edges.push_back(move(edge.element));
+        }
+    }
+    sort(nodes.begin(), nodes.end());
+    sort(edges.begin(), edges.end());
+
+    fingerprint_builder content;
+    content.begin('A');
+    content.field(parent.c_str());
+    content.attributes(sub, graph_syms);
+    for (const string& n : nodes)
+        content.field(n.c_str());
+    for (string& e : edges)
+        content.element += e;
+    uint64_t hash[2];
+    murmur3_128(content.element, hash);
+    char key[64];
+    snprintf(key, sizeof(key), "%%anonymous-%016llx%016llx", (unsigned long long)hash[0], (unsigned long long)hash[1]);
+    return key;
+}
+
+// The parent of the top level subgraphs is the graph that is fingerprinted, whose name is not part of
+// the fingerprint, so it is hashed as the empty name. The elements of all subgraphs are summed like
+// those of the graph itself, so the order in which siblings were created does not matter.
+static void fingerprint_subgraphs(fingerprint_builder& fingerprint, Agraph_t* g, const string& parent, bool directed,
+    const vector<pair<string, Agsym_t*>>& graph_syms)
+{
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+    {
+        string name = subgraph_key(sub, parent, directed, graph_syms);
+        fingerprint.begin('S');
+        fingerprint.field(name.c_str());
+        fingerprint.field(parent.c_str());
+        fingerprint.attributes(sub, graph_syms);
+        fingerprint.end();
+        for (Agnode_t* n = agfstnode(sub); n; n = agnxtnode(sub, n))
+        {
+            fingerprint.begin('n');
+            fingerprint.field(name.c_str());
+            fingerprint.field(name_of(n).c_str());
+            fingerprint.end();
+            for (Agedge_t* e = agfstout(sub, n); e; e = agnxtout(sub, e))
+            {
+                fingerprint.begin('e');
+                fingerprint.field(name.c_str());
+                fingerprint_edge(fingerprint, e, directed);
+                fingerprint.end();
+            }
+        }
+        fingerprint_subgraphs(fingerprint, sub, name, directed, graph_syms);
+    }
+}
+
+void rj_graph_fingerprint(Agraph_t* g, const char* attributes, const int* offsets, int count, uint64_t* result)
+{
+    Agraph_t* root = agroot(g);
+    bool directed = agisdirected(root);
+    vector<pair<string, Agsym_t*>> syms[3];
+    for (int i = 0; i < count; i++)
+    {
+        string name(attributes + offsets[i], attributes + offsets[i + 1]);
+        for (int kind = 0; kind < 3; kind++)
+            syms[kind].emplace_back(name, agattr(root, kind, const_cast<char*>(name.c_str()), nullptr));
+    }
+
+    fingerprint_builder fingerprint;
+    fingerprint.begin('G');
+    fingerprint.field(directed ? "directed" : "undirected");
+    fingerprint.field(agisstrict(root) ? "strict" : "");
+    fingerprint.attributes(g, syms[AGRAPH]);
+    fingerprint.end();
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+    {
+        fingerprint.begin('N');
+        fingerprint.field(name_of(n).c_str());
+        fingerprint.attributes(n, syms[AGNODE]);
+        fingerprint.end();
+        for (Agedge_t* e = agfstout(g, n); e; e = agnxtout(g, e))
+        {
+            fingerprint.begin('E');
+            fingerprint_edge(fingerprint, e, directed);
+            fingerprint.attributes(e, syms[AGEDGE]);
+            fingerprint.end();
+        }
+    }
+    fingerprint_subgraphs(fingerprint, g, "", directed, syms[AGRAPH]);
+
+    // Mix the sums, such that the result is not linear in the element hashes
+    uint64_t h1 = fmix64(fingerprint.sum[0] ^ fingerprint.count);
+    uint64_t h2 = fmix64(fingerprint.sum[1] + h1);
+    result[0] = h1 + h2;
+    result[1] = h2;
+}
+
+struct union_find
+{
+    unordered_map<Agnode_t*, Agnode_t*> parent;
+
+    Agnode_t* find(Agnode_t* n)
+    {
+        Agnode_t* root = n;
+        while (parent[root] != root)
+            root = parent[root];
+        // Path compression
+        while (parent[n] != root)
+        {
+            Agnode_t* next = parent[n];
+            parent[n] = root;
+            n = next;
+        }
+        return root;
+    }
+
+    void unite(Agnode_t* a, Agnode_t* b)
+    {
+        parent[find(a)] = find(b);
+    }
+};
+
+static void unite_subgraph_members(union_find& sets, Agraph_t* g)
+{
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+    {
+        Agnode_t* first = agfstnode(sub);
+        for (Agnode_t* n = first; n; n = agnxtnode(sub, n))
+            sets.unite(first, n);
+        unite_subgraph_members(sets, sub);
+    }
+}
+
+// Split g into new root graphs, one for each connected component. The nodes of a subgraph are kept
+// together in one component, so clusters and rank constraints are laid out as a whole.
+// Each component has the graph attributes of g. Stores the number of components in count.
+// This function transfers ownership of the result array. The caller has to call free_str to free it,
+// and agclose for each of the graphs. Returns null if the result or any of the graphs could not be created.
+Agraph_t** rj_split_components(Agraph_t* g, int* count)
+{
+    union_find sets;
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+        sets.parent[n] = n;
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+        for (Agedge_t* e = agfstout(g, n); e; e = agnxtout(g, e))
+            sets.unite(n, aghead(e));
+    unite_subgraph_members(sets, g);
+
+    // Number the components in the order of their first node
+    unordered_map<Agnode_t*, int> components;
+    unordered_map<Agnode_t*, int> numbers;
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+    {
+        auto number = numbers.emplace(sets.find(n), (int)numbers.size()).first->second;
+        components[n] = number;
+    }
+
+    *count = (int)numbers.size();
+    Agraph_t** result = (Agraph_t**)malloc(sizeof(Agraph_t*) * (numbers.size() + 1));
+    if (!result)
+        return nullptr;
+    for (int i = 0; i < *count; i++)
+    {
+        result[i] = open_like(g, agnameof(g));
+        if (!result[i])
+        {
+            // All or nothing, such that the caller never sees a missing component
+            for (int j = 0; j < i; j++)
+                agclose(result[j]);
+            free(result);
+            *count = 0;
+            return nullptr;
+        }
+        clone_state state;
+        state.components = &components;
+        state.component = i;
+        clone_into(g, result[i], state);
+    }
+    return result;
+}
+
+// The subgraphs of a root graph by name. Once built, it is kept up to date by cgraph callbacks
+// for every subgraph that is created or closed, and it is freed when the root graph is closed.
+struct subgraph_index
+{
+    unordered_map<string, vector<Agraph_t*>> by_name;
+    unordered_map<Agraph_t*, string> names;
+
+    void insert(Agraph_t* g)
+    {
+        string name = agnameof(g);
+        by_name[name].push_back(g);
+        names.emplace(g, move(name));
+    }
+
+    void erase(Agraph_t* g)
+    {
+        auto name = names.find(g);
+        if (name == names.end())
+            return;
+        auto& subgraphs = by_name[name->second];
+        subgraphs.erase(find(subgraphs.begin(), subgraphs.end(), g));
+        if (subgraphs.empty())
+            by_name.erase(name->second);
+        names.erase(name);
+    }
+};
+
+// Only accessed while holding the global lock
+static unordered_map<Agraph_t*, subgraph_index*> subgraph_indices;
+
+static void subgraph_inserted(Agraph_t*, Agobj_t* obj, void* state)
+{
+    static_cast<subgraph_index*>(state)->insert(reinterpret_cast<Agraph_t*>(obj));
+}
+
+static void subgraph_deleted(Agraph_t*, Agobj_t* obj, void* state)
+{
+    auto index = static_cast<subgraph_index*>(state);
+    auto g = reinterpret_cast<Agraph_t*>(obj);
+    if (g != agroot(g))
+    {
+        index->erase(g);
+        return;
+    }
+    subgraph_indices.erase(g);
+    delete index;
+}
+
+static Agcbdisc_t subgraph_index_disc = {
+    { subgraph_inserted, nullptr, subgraph_deleted },
+    { nullptr, nullptr, nullptr },
+    { nullptr, nullptr, nullptr },
+};
+
+// In pre order, such that the first of several subgraphs with the same name is the first one that
+// Graph.Descendants() would produce
+static void index_subgraphs(subgraph_index& index, Agraph_t* g)
+{
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+    {
+        index.insert(sub);
+        index_subgraphs(index, sub);
+    }
+}
+
+Agraph_t* rj_find_descendant(Agraph_t* g, const char* name)
+{
+    Agraph_t* root = agroot(g);
+    auto found = subgraph_indices.find(root);
+    subgraph_index* index;
+    if (found != subgraph_indices.end())
+        index = found->second;
+    else
+    {
+        index = new subgraph_index();
+        index_subgraphs(*index, root);
+        agpushdisc(root, &subgraph_index_disc, index);
+        subgraph_indices[root] = index;
+    }
+
+    auto candidates = index->by_name.find(name);
+    if (candidates == index->by_name.end())
+        return nullptr;
+    for (Agraph_t* candidate : candidates->second)
+    {
+        for (Agraph_t* parent = agparent(candidate); parent; parent = agparent(parent))
+        {
+            if (parent == g)
+                return candidate;
+        }
+    }
+    return nullptr;
+}
+
+// Top down, such that subgraphs that are deleted along with an ancestor are not closed twice.
+// The children are collected before any of them is deleted, because deleting invalidates the iteration.
+static int delete_marked_subgraphs(Agraph_t* g, const unordered_set<Agraph_t*>& marked)
+{
+    int deleted = 0;
+    vector<Agraph_t*> children;
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+        children.push_back(sub);
+    for (Agraph_t* child : children)
+    {
+        if (marked.count(child))
+        {
+            agclose(child);
+            ++deleted;
+        }
+        else
+            deleted += delete_marked_subgraphs(child, marked);
+    }
+    return deleted;
+}
+
+int rj_delete_subgraphs(Agraph_t* g, Agraph_t** subgraphs, int count)
+{
+    unordered_set<Agraph_t*> marked(subgraphs, subgraphs + count);
+    return delete_marked_subgraphs(g, marked);
+}
+
+// A snapshot of the subgraph hierarchy, which does not change while filtered copies are added to it
+struct subgraph_tree
+{
+    Agraph_t* graph;
+    vector<subgraph_tree> children;
+};
+
+static subgraph_tree snapshot_subgraphs(Agraph_t* g, Agraph_t* exclude)
+{
+    subgraph_tree tree{ g, {} };
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+        if (sub != exclude)
+            tree.children.push_back(snapshot_subgraphs(sub, exclude));
+    return tree;
+}
+
+// Add a copy of every subgraph of origin that contains nodes of the filter to target, with only those nodes.
+// Subgraphs without such nodes are skipped, and so are their descendants, which cannot contain any either.
+static void add_filtered_subgraphs(const subgraph_tree& origin, Agraph_t* target, const string& prefix,
+    const unordered_set<Agnode_t*>& filter)
+{
+    for (const subgraph_tree& child : origin.children)
+    {
+        Agraph_t* filtered = nullptr;
+        for (Agnode_t* n = agfstnode(child.graph); n; n = agnxtnode(child.graph, n))
+        {
+            if (!filter.count(n))
+                continue;
+            if (!filtered)
+                filtered = agsubg(target, const_cast<char*>((prefix + agnameof(child.graph)).c_str()), 1);
+            agsubnode(filtered, n, 1);
+        }
+        if (!filtered)
+            continue;
+        agcopyattr(child.graph, filtered);
+        add_filtered_subgraphs(child, filtered, prefix, filter);
+    }
+}
+
+static void delete_empty_subgraphs(Agraph_t* g)
+{
+    vector<Agraph_t*> empty;
+    for (Agraph_t* sub = agfstsubg(g); sub; sub = agnxtsubg(sub))
+    {
+        if (agfstnode(sub))
+            delete_empty_subgraphs(sub);
+        else
+            empty.push_back(sub);
+    }
+    for (Agraph_t* sub : empty)
+        agclose(sub);
+}
+
+// The subgraph of g with the given name, induced by the given nodes. Every subgraph of g is copied into it,
+// in the same position in the hierarchy, with the name "name:subgraphname" and only the given nodes.
+Agraph_t* rj_add_subgraph_from_nodes(Agraph_t* g, const char* name, Agnode_t** nodes, int count)
+{
+    Agraph_t* existing = agsubg(g, const_cast<char*>(name), 0);
+    subgraph_tree descendants = snapshot_subgraphs(g, existing);
+
+    Agraph_t* result = existing ? existing : agsubg(g, const_cast<char*>(name), 1);
+    unordered_set<Agnode_t*> filter;
+    filter.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        filter.insert(nodes[i]);
+        agsubnode(result, nodes[i], 1);
+    }
+    graphviz_node_induce(result, g);
+
+    add_filtered_subgraphs(descendants, result, string(name) + ":", filter);
+    delete_empty_subgraphs(result);
+    return result;
+}
+
+// Directions: 0 follows out edges, 1 follows in edges, 2 follows both
+static Agedge_t* first_edge(Agraph_t* g, Agnode_t* n, int direction)
+{
+    return direction == 0 ? agfstout(g, n) : direction == 1 ? agfstin(g, n) : agfstedge(g, n);
+}
+
+static Agedge_t* next_edge(Agraph_t* g, Agedge_t* e, Agnode_t* n, int direction)
+{
+    return direction == 0 ? agnxtout(g, e) : direction == 1 ? agnxtin(g, e) : agnxtedge(g, e, n);
+}
+
+static Agnode_t* opposite(Agedge_t* e, Agnode_t* n)
+{
+    return aghead(e) == n ? agtail(e) : aghead(e);
+}
+
+// Copy the nodes, and optionally their depths, into arrays that are freed with free_str
+static Agnode_t** release_traversal(const vector<Agnode_t*>& nodes, const vector<int>& depths, int** depths_result, int* count)
+{
+    Agnode_t** result = (Agnode_t**)malloc(sizeof(Agnode_t*) * (nodes.size() + 1));
+    int* depths_copy = depths_result ? (int*)malloc(sizeof(int) * (depths.size() + 1)) : nullptr;
+    if (!result || (depths_result && !depths_copy))
+    {
+        free(result);
+        free(depths_copy);
+        *count = 0;
+        return nullptr;
+    }
+    copy(nodes.begin(), nodes.end(), result);
+    if (depths_result)
+    {
+        copy(depths.begin(), depths.end(), depths_copy);
+        *depths_result = depths_copy;
+    }
+    *count = (int)nodes.size();
+    return result;
+}
+
+// The nodes of g that are reachable from source, in breadth first order (order 0), or in depth first
+// pre order (1) or post order (2). The depth of a node is its distance from the source in breadth first order,
+// and its depth in the search tree otherwise. Edges of undirected graphs are followed in both directions.
+Agnode_t** rj_traverse(Agraph_t* g, Agnode_t* source, int order, int direction, int** depths, int* count)
+{
+    if (!agisdirected(g))
+        direction = 2;
+    vector<Agnode_t*> nodes;
+    vector<int> node_depths;
+    unordered_set<Agnode_t*> visited;
+    visited.reserve(agnnodes(g));
+    visited.insert(source);
+
+    if (order == 0)
+    {
+        nodes.push_back(source);
+        node_depths.push_back(0);
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            Agnode_t* n = nodes[i];
+            for (Agedge_t* e = first_edge(g, n, direction); e; e = next_edge(g, e, n, direction))
+            {
+                Agnode_t* m = opposite(e, n);
+                if (visited.insert(m).second)
+                {
+                    nodes.push_back(m);
+                    node_depths.push_back(node_depths[i] + 1);
+                }
+            }
+        }
+        return release_traversal(nodes, node_depths, depths, count);
+    }
+
+    // An explicit stack, because the recursion could be as deep as the graph is large
+    vector<pair<Agnode_t*, Agedge_t*>> stack;
+    stack.emplace_back(source, first_edge(g, source, direction));
+    if (order == 1)
+    {
+        nodes.push_back(source);
+        node_depths.push_back(0);
+    }
+    while (!stack.empty())
+    {
+        Agnode_t* n = stack.back().first;
+        Agedge_t* e = stack.back().second;
+        if (!e)
+        {
+            if (order == 2)
+            {
+                nodes.push_back(n);
+                node_depths.push_back((int)stack.size() - 1);
+            }
+            stack.pop_back();
+            continue;
+        }
+        stack.back().second = next_edge(g, e, n, direction);
+        Agnode_t* m = opposite(e, n);
+        if (visited.insert(m).second)
+        {
+            if (order == 1)
+            {
+                nodes.push_back(m);
+                node_depths.push_back((int)stack.size());
+            }
+            stack.emplace_back(m, first_edge(g, m, direction));
+        }
+    }
+    return release_traversal(nodes, node_depths, depths, count);
+}
+
+// All nodes of g, such that every edge points from an earlier node to a later node. Nodes are taken in breadth
+// first order, starting from the nodes without in edges in the order of agfstnode.
+// Returns null with a count of -1 if g contains a cycle.
+Agnode_t** rj_topological_sort(Agraph_t* g, int* count)
+{
+    unordered_map<Agnode_t*, int> in_degrees;
+    in_degrees.reserve(agnnodes(g));
+    vector<Agnode_t*> nodes;
+    for (Agnode_t* n = agfstnode(g); n; n = agnxtnode(g, n))
+    {
+        int in_degree = 0;
+        for (Agedge_t* e = agfstin(g, n); e; e = agnxtin(g, e))
+            ++in_degree;
+        in_degrees[n] = in_degree;
+        if (in_degree == 0)
+            nodes.push_back(n);
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        for (Agedge_t* e = agfstout(g, nodes[i]); e; e = agnxtout(g, e))
+        {
+            if (--in_degrees[aghead(e)] == 0)
+                nodes.push_back(aghead(e));
+        }
+    }
+
+    if (nodes.size() != in_degrees.size())
+    {
+        *count = -1;
+        return nullptr;
+    }
+    return release_traversal(nodes, {}, nullptr, count);
+}
+
+// Move every number in a list of points or rectangles, like "e,1,2 3,4 5,6" or "1,2,3,4", by (dx, dy).
+// Numbers alternate between x and y. Points with three coordinates keep their z coordinate.
+static string translate_points(const char* value, double dx, double dy)
+{
+    string result;
+    const char* p = value;
+    while (*p)
+    {
+        if (*p == ' ' || *p == ';' || *p == '\n' || *p == '\t' || *p == '\\')
+        {
+            result += *p++;
+            continue;
+        }
+        // Spline end points are prefixed with "e," or "s,"
+        if ((*p == 'e' || *p == 's') && p[1] == ',')
+        {
+            result.append(p, 2);
+            p += 2;
+        }
+        const char* end = p;
+        while (*end && *end != ' ' && *end != ';' && *end != '\n' && *end != '\t' && *end != '\\')
+            end++;
+        string token(p, end);
+        vector<string> parts;
+        size_t start = 0;
+        for (size_t comma; (comma = token.find(',', start)) != string::npos; start = comma + 1)
+            parts.push_back(token.substr(start, comma - start));
+        parts.push_back(token.substr(start));
+        for (size_t i = 0; i < parts.size(); i++)
+        {
+            if (i > 0)
+                result += ',';
+            char* parsed_end = nullptr;
+            double number = strtod(parts[i].c_str(), &parsed_end);
+            if (parts[i].empty() || *parsed_end || (parts.size() == 3 && i == 2))
+            {
+                result += parts[i];
+                continue;
+            }
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.10g", number + (i % 2 == 0 ? dx : dy));
+            result += buffer;
+        }
+        p = end;
+    }
+    return result;
+}
+
+static bool is_point_attribute(const char* name)
+{
+    static const char* const names[] = { "pos", "lp", "xlp", "head_lp", "tail_lp", "bb", "rects" };
+    for (const char* candidate : names)
+        if (strcmp(name, candidate) == 0)
+            return true;
+    return false;
+}
+
+static bool is_xdot_attribute(const char* name)
+{
+    static const char* const names[] = { "_draw_", "_ldraw_", "_hdraw_", "_tdraw_", "_hldraw_", "_tldraw_", "_background" };
+    for (const char* candidate : names)
+        if (strcmp(name, candidate) == 0)
+            return true;
+    return false;
+}
+
+// Copy all attribute values of from onto to, moving the coordinates in them by (dx, dy)
+static void merge_layout_attributes(void* from, void* to, int kind, double dx, double dy)
+{
+    Agraph_t* root = agroot(from);
+    Agraph_t* target_root = agroot(to);
+    for (Agsym_t* sym = agnxtattr(root, kind, nullptr); sym; sym = agnxtattr(root, kind, sym))
+    {
+        if (kind == AGEDGE && strcmp(sym->name, "key") == 0)
+            continue;
+        Agsym_t* target_sym = agattr(target_root, kind, sym->name, nullptr);
+        if (!target_sym)
+            target_sym = agattr(target_root, kind, sym->name, const_cast<char*>(""));
+        const char* value = agxget(from, sym);
+        string translated;
+        if (*value && is_point_attribute(sym->name))
+        {
+            translated = translate_points(value, dx, dy);
+            value = translated.c_str();
+        }
+        else if (*value && is_xdot_attribute(sym->name))
+        {
+            char* moved = rj_translate_xdot(value, dx, dy);
+            translated = moved;
+            free(moved);
+            value = translated.c_str();
+        }
+        if (strcmp(value, agxget(to, target_sym)) != 0)
+            agxset(to, target_sym, value);
+    }
+}
+
+static void merge_layout_subgraphs(Agraph_t* from, Agraph_t* to, double dx, double dy)
+{
+    for (Agraph_t* sub = agfstsubg(from); sub; sub = agnxtsubg(sub))
+    {
+        Agraph_t* target = agsubg(to, agnameof(sub), 0);
+        if (!target)
+            continue;
+        merge_layout_attributes(sub, target, AGRAPH, dx, dy);
+        merge_layout_subgraphs(sub, target, dx, dy);
+    }
+}
+
+// Copy the layout attributes of the nodes, edges and subgraphs of layout onto the corresponding
+// objects in target, moving their coordinates by (dx, dy). Objects are matched by name, and
+// parallel edges between the same nodes with the same name are matched in order.
+// The attributes of the root graph itself are not merged.
+void rj_merge_layout(Agraph_t* target, Agraph_t* layout, double dx, double dy)
+{
+    unordered_map<string, vector<Agedge_t*>> target_edges;
+    for (Agnode_t* n = agfstnode(layout); n; n = agnxtnode(layout, n))
+    {
+        Agnode_t* target_node = agnode(target, agnameof(n), 0);
+        if (!target_node)
+            continue;
+        merge_layout_attributes(n, target_node, AGNODE, dx, dy);
+
+        // Candidates are consumed from the back, so store them in reverse order
+        target_edges.clear();
+        vector<Agedge_t*> edges;
+        for (Agedge_t* e = agfstout(target, target_node); e; e = agnxtout(target, e))
+            edges.push_back(e);
+        for (auto e = edges.rbegin(); e != edges.rend(); ++e)
+            target_edges[name_of(*e) + '\0' + name_of(aghead(*e))].push_back(*e);
+
+        for (Agedge_t* e = agfstout(layout, n); e; e = agnxtout(layout, e))
+        {
+            auto candidates = target_edges.find(name_of(e) + '\0' + name_of(aghead(e)));
+            if (candidates == target_edges.end() || candidates->second.empty())
+                continue;
+            merge_layout_attributes(e, candidates->second.back(), AGEDGE, dx, dy);
+            candidates->second.pop_back();
+        }
+    }
+    merge_layout_subgraphs(layout, target, dx, dy);
+}
+
+// The builtins of a context are referenced by graphviz for as long as the context lives
+struct context_builtins
+{
+    vector<string> names;
+    vector<lt_symlist_t> symbols;
+};
+static unordered_map<GVC_t*, context_builtins> builtins_of_context;
+
+// The plugin libraries stay loaded, because graphviz keeps pointers into them
+static void* load_plugin_library(const string& name)
+{
+    string symbol = "gvplugin_" + name + "_LTX_library";
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(("gvplugin_" + name + ".dll").c_str());
+    return library ? reinterpret_cast<void*>(GetProcAddress(library, symbol.c_str())) : nullptr;
+#else
+    void* library = dlopen(("libgvplugin_" + name + ".so.6").c_str(), RTLD_NOW);
+    if (!library)
+        library = dlopen(("libgvplugin_" + name + ".so").c_str(), RTLD_NOW);
+    return library ? dlsym(library, symbol.c_str()) : nullptr;
+#endif
+}
+
+GVC_t* rj_context_plugins(const char* names, const int* offsets, int count, int demand_loading)
+{
+    context_builtins builtins;
+    builtins.names.reserve(count);
+    for (int i = 0; i < count; ++i)
+        builtins.names.emplace_back("gvplugin_" + string(names + offsets[i], names + offsets[i + 1]) + "_LTX_library");
+    for (int i = 0; i < count; ++i)
+    {
+        void* address = load_plugin_library(string(names + offsets[i], names + offsets[i + 1]));
+        if (!address)
+            return nullptr;
+        builtins.symbols.push_back({ builtins.names[i].c_str(), address });
+    }
+    builtins.symbols.push_back({ nullptr, nullptr });
+
+    GVC_t* gvc = gvContextPlugins(builtins.symbols.data(), demand_loading);
+    if (gvc)
+        builtins_of_context[gvc] = move(builtins);
+    return gvc;
+}
+
+int rj_free_context(GVC_t* gvc)
+{
+    int rc = gvFreeContext(gvc);
+    builtins_of_context.erase(gvc);
+    return rc;
+}
@@ -1,89 +1,223 @@
+#include <cstring>
+#include <string>
+#include <vector>
 #include "GraphvizWrapper.h"
 
 // See https://graphviz.org/docs/outputs/canon/#xdot for specifications
 
-// Accessors for xdot
-size_t get_cnt(xdot* xdot) { return xdot->cnt; }
-xdot_op* get_ops(xdot* xdot) { return xdot->ops; }
-
-// Accessors for xdot_op
-xdot_kind get_kind(xdot_op* op) { return op->kind; }
-xdot_rect* get_ellipse(xdot_op* op) { return &op->u.ellipse; }
-xdot_polyline* get_polygon(xdot_op* op) { return &op->u.polygon; }
-xdot_polyline* get_polyline(xdot_op* op) { return &op->u.polyline; }
-xdot_polyline* get_bezier(xdot_op* op) { return &op->u.bezier; }
-xdot_text* get_text(xdot_op* op) { return &op->u.text; }
-xdot_image* get_image(xdot_op* op) { return &op->u.image; }
-char* get_color(xdot_op* op) { return op->u.color; }
-xdot_color* get_grad_color(xdot_op* op) { return &op->u.grad_color; }
-xdot_font* get_font(xdot_op* op) { return &op->u.font; }
-char* get_style(xdot_op* op) { return op->u.style; }
-unsigned int get_fontchar(xdot_op* op) { return op->u.fontchar; }
-
-// Accessors for xdot_image
-xdot_rect* get_pos(xdot_image* img) { return &img->pos; }
-char* get_name_image(xdot_image* img) { return img->name; }
-
-// Accessors for xdot_font
-double get_size(xdot_font* font) { return font->size; }
-char* get_name_font(xdot_font* font) { return font->name; }
-
-// Accessors for xdot_color
-xdot_grad_type get_type(xdot_color* clr) { return clr->type; }
-char* get_clr(xdot_color* clr) { return clr->u.clr; }
-xdot_linear_grad* get_ling(xdot_color* clr) { return &clr->u.ling; }
-xdot_radial_grad* get_ring(xdot_color* clr) { return &clr->u.ring; }
-
-// Accessors for xdot_text
-double get_x_text(xdot_text* txt) { return txt->x; }
-double get_y_text(xdot_text* txt) { return txt->y; }
-xdot_align get_align(xdot_text* txt) { return txt->align; }
-double get_width(xdot_text* txt) { return txt->width; }
-char* get_text_str(xdot_text* txt) { return txt->text; }
-
-// Accessors for xdot_linear_grad
-double get_x0_ling(xdot_linear_grad* ling) { return ling->x0; }
-double get_y0_ling(xdot_linear_grad* ling) { return ling->y0; }
-double get_x1_ling(xdot_linear_grad* ling) { return ling->x1; }
-double get_y1_ling(xdot_linear_grad* ling) { return ling->y1; }
-int get_n_stops_ling(xdot_linear_grad* ling) { return ling->n_stops; }
-xdot_color_stop* get_stops_ling(xdot_linear_grad* ling) { return ling->stops; }
-
-// Accessors for xdot_radial_grad
-double get_x0_ring(xdot_radial_grad* ring) { return ring->x0; }
-double get_y0_ring(xdot_radial_grad* ring) { return ring->y0; }
-double get_r0_ring(xdot_radial_grad* ring) { return ring->r0; }
-double get_x1_ring(xdot_radial_grad* ring) { return ring->x1; }
-double get_y1_ring(xdot_radial_grad* ring) { return ring->y1; }
-double get_r1_ring(xdot_radial_grad* ring) { return ring->r1; }
-int get_n_stops_ring(xdot_radial_grad* ring) { return ring->n_stops; }
-xdot_color_stop* get_stops_ring(xdot_radial_grad* ring) { return ring->stops; }
-
-// Accessors for xdot_color_stop
-float get_frac(xdot_color_stop* stop) { return stop->frac; }
-char* get_color_stop(xdot_color_stop* stop) { return stop->color; }
-
-// Accessors for xdot_polyline
-size_t get_cnt_polyline(xdot_polyline* polyline) { return polyline->cnt; }
-xdot_point* get_pts_polyline(xdot_polyline* polyline) { return polyline->pts; }
-
-// Accessors for xdot_point
-double get_x_point(xdot_point* point) { return point->x; }
-double get_y_point(xdot_point* point) { return point->y; }
-double get_z_point(xdot_point* point) { return point->z; }
-
-// Accessors for xdot_rect
-double get_x_rect(xdot_rect* rect) { return rect->x; }
-double get_y_rect(xdot_rect* rect) { return rect->y; }
-double get_w_rect(xdot_rect* rect) { return rect->w; }
-double get_h_rect(xdot_rect* rect) { return rect->h; }
-
-// Index function for xdot_color_stop array
-xdot_color_stop* get_color_stop_at_index(xdot_color_stop* stops, int index) { return &stops[index]; }
-
-// Index function for xdot_op array
-xdot_op* get_op_at_index(xdot_op* ops, int index) { return &ops[index]; }
-
-// Index function for xdot_point array
-xdot_point* get_pt_at_index(xdot_point* pts, int index) { return &pts[index]; }
-
+// Packed representation of an entire xdot, so that it can be marshaled in a single call.
+// The layout of the buffer is as follows, all in native byte order:
+//   header:  int32 version, int32 op count, int32 int count, int32 double count, int32 string bytes
+//   ints:    int32[int count]
+//   doubles: double[double count]
+//   strings: null terminated utf8 strings, concatenated
+// For each op the kind is written to the ints, followed by kind specific data.
+// Strings are referred to by their byte offset into the strings section, or -1 for null.
+// See XDotParser.cs for the decoder.
+struct XDotPacker
+{
+    std::vector<int> ints;
+    std::vector<double> doubles;
+    std::string strings;
+
+    void str(const char* s)
+    {
+        if (s == nullptr)
+        {
+            ints.push_back(-1);
+            return;
+        }
+        ints.push_back((int)strings.size());
+        strings.append(s);
+        strings.push_back('\0');
+    }
+
+    void rect(const xdot_rect& r)
+    {
+        doubles.insert(doubles.end(), { r.x, r.y, r.w, r.h });
+    }
+
+    void polyline(const xdot_polyline& p)
+    {
+        ints.push_back((int)p.cnt);
+        for (size_t i = 0; i < p.cnt; ++i)
+            doubles.insert(doubles.end(), { p.pts[i].x, p.pts[i].y });
+    }
+
+    void stops(int n_stops, const xdot_color_stop* stops)
+    {
+        ints.push_back(n_stops);
+        for (int i = 0; i < n_stops; ++i)
+        {
+            doubles.push_back(stops[i].frac);
+            str(stops[i].color);
+        }
+    }
+
+    void color(const xdot_color& c)
+    {
+        ints.push_back(c.type);
+        switch (c.type)
+        {
+        case xd_none:
+            str(c.u.clr);
+            break;
+        case xd_linear:
+            doubles.insert(doubles.end(), { c.u.ling.x0, c.u.ling.y0, c.u.ling.x1, c.u.ling.y1 });
+            stops(c.u.ling.n_stops, c.u.ling.stops);
+            break;
+        case xd_radial:
+            doubles.insert(doubles.end(), { c.u.ring.x0, c.u.ring.y0, c.u.ring.r0, c.u.ring.x1, c.u.ring.y1, c.u.ring.r1 });
+            stops(c.u.ring.n_stops, c.u.ring.stops);
+            break;
+        }
+    }
+
+    void op(const xdot_op& op)
+    {
+        ints.push_back(op.kind);
+        switch (op.kind)
+        {
+        case xd_filled_ellipse:
+        case xd_unfilled_ellipse:
+            rect(op.u.ellipse);
+            break;
+        case xd_filled_polygon:
+        case xd_unfilled_polygon:
+        case xd_filled_bezier:
+        case xd_unfilled_bezier:
+        case xd_polyline:
+            polyline(op.u.polyline);
+            break;
+        case xd_text:
+            doubles.insert(doubles.end(), { op.u.text.x, op.u.text.y, op.u.text.width });
+            ints.push_back(op.u.text.align);
+            str(op.u.text.text);
+            break;
+        case xd_fill_color:
+        case xd_pen_color:
+            str(op.u.color);
+            break;
+        case xd_grad_fill_color:
+        case xd_grad_pen_color:
+            color(op.u.grad_color);
+            break;
+        case xd_font:
+            doubles.push_back(op.u.font.size);
+            str(op.u.font.name);
+            break;
+        case xd_style:
+            str(op.u.style);
+            break;
+        case xd_image:
+            rect(op.u.image.pos);
+            str(op.u.image.name);
+            break;
+        case xd_fontchar:
+            ints.push_back((int)op.u.fontchar);
+            break;
+        }
+    }
+};
+
+// This function transfers ownership of the result.
+// The caller has to call free_str to free it.
+char* pack_xdot(xdot* xdot)
+{
+    XDotPacker packer;
+    for (size_t i = 0; i < xdot->cnt; ++i)
+        packer.op(xdot->ops[i]);
+
+    int header[XDOT_PACK_HEADER_INTS] = {
+        XDOT_PACK_VERSION,
+        (int)xdot->cnt,
+        (int)packer.ints.size(),
+        (int)packer.doubles.size(),
+        (int)packer.strings.size(),
+    };
+    size_t headerBytes = sizeof(header);
+    size_t intBytes = packer.ints.size() * sizeof(int);
+    size_t doubleBytes = packer.doubles.size() * sizeof(double);
+    size_t stringBytes = packer.strings.size();
+
+    char* result = (char*)malloc(headerBytes + intBytes + doubleBytes + stringBytes);
+    if (result == nullptr)
+        return nullptr;
+    char* cursor = result;
+    memcpy(cursor, header, headerBytes);
+    cursor += headerBytes;
+    memcpy(cursor, packer.ints.data(), intBytes);
+    cursor += intBytes;
+    memcpy(cursor, packer.doubles.data(), doubleBytes);
+    cursor += doubleBytes;
+    memcpy(cursor, packer.strings.data(), stringBytes);
+    return result;
+}
+
+static void translate_color(xdot_color& c, double dx, double dy)
+{
+    if (c.type == xd_linear)
+    {
+        c.u.ling.x0 += dx; c.u.ling.y0 += dy;
+        c.u.ling.x1 += dx; c.u.ling.y1 += dy;
+    }
+    else if (c.type == xd_radial)
+    {
+        c.u.ring.x0 += dx; c.u.ring.y0 += dy;
+        c.u.ring.x1 += dx; c.u.ring.y1 += dy;
+    }
+}
+
+// Move all coordinates in the given xdot string by (dx, dy).
+// This function transfers ownership of the result. The caller has to call free_str to free it.
+char* rj_translate_xdot(const char* s, double dx, double dy)
+{
+    std::string input(s ? s : "");
+    xdot* parsed = parseXDot(&input[0]);
+    if (parsed == nullptr)
+        return STRDUP(input.c_str());
+
+    for (size_t i = 0; i < parsed->cnt; ++i)
+    {
+        xdot_op& op = parsed->ops[i];
+        switch (op.kind)
+        {
+        case xd_filled_ellipse:
+        case xd_unfilled_ellipse:
+            op.u.ellipse.x += dx;
+            op.u.ellipse.y += dy;
+            break;
+        case xd_filled_polygon:
+        case xd_unfilled_polygon:
+        case xd_filled_bezier:
+        case xd_unfilled_bezier:
+        case xd_polyline:
+            for (size_t j = 0; j < op.u.polyline.cnt; ++j)
+            {
+                op.u.polyline.pts[j].x += dx;
+                op.u.polyline.pts[j].y += dy;
+            }
+            break;
+        case xd_text:
+            op.u.text.x += dx;
+            op.u.text.y += dy;
+            break;
+        case xd_image:
+            op.u.image.pos.x += dx;
+            op.u.image.pos.y += dy;
+            break;
+        case xd_grad_fill_color:
+        case xd_grad_pen_color:
+            translate_color(op.u.grad_color, dx, dy);
+            break;
+        default:
+            break;
+        }
+    }
+
+    char* printed = sprintXDot(parsed);
+    freeXDot(parsed);
+    char* result = STRDUP(printed ? printed : "");
+    free(printed);
+    return result;
+}
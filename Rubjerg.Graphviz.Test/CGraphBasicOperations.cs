@@ -1,4 +1,5 @@
 using System;
+using System.Collections.Generic;
 using System.Linq;
 using NUnit.Framework;
 
@@ -24,6 +25,339 @@ public void TestCopyAttributes()
         Assert.AreEqual("bar", n2.GetAttribute("test"));
     }
 
+    [Test()]
+    public void TestAttributeHandles()
+    {
+        RootGraph root = Utils.CreateUniqueTestGraph();
+        Node n1 = root.GetOrAddNode("1");
+        Node n2 = root.GetOrAddNode("2");
+        Edge e = root.GetOrAddEdge(n1, n2);
+        Assert.IsNull(n1.GetAttributeHandle("color"));
+
+        var color = Node.GetAttributeHandle(root, "color", "black");
+        Assert.AreEqual("black", n1.GetAttribute(color));
+        n1.SetAttribute(color, "red");
+        Assert.AreEqual("red", n1.GetAttribute("color"));
+        Assert.AreEqual("black", n2.GetAttribute(color));
+
+        // Resolving an existing attribute does not change its default
+        var color2 = Node.GetAttributeHandle(root, "color", "blue");
+        Assert.AreEqual("black", n2.GetAttribute(color2));
+        n2.SetAttribute("color", "green");
+        Assert.AreEqual("green", n2.GetAttribute(n2.GetAttributeHandle("color")!));
+
+        var edgeColor = Edge.GetAttributeHandle(root, "color");
+        e.SetAttribute(edgeColor, "blue");
+        Assert.AreEqual("blue", e.GetAttribute("color"));
+        Assert.AreEqual("red", n1.GetAttribute("color"));
+
+        RootGraph root2 = Utils.CreateUniqueTestGraph();
+        Node other = root2.GetOrAddNode("1");
+        _ = Assert.Throws<ArgumentException>(() => e.GetAttribute(color));
+        _ = Assert.Throws<ArgumentException>(() => other.SetAttribute(color, "red"));
+    }
+
+    [Test()]
+    public void TestAddSubgraphFromNodes()
+    {
+        var root = Utils.CreateUniqueTestGraph();
+        var a = root.GetOrAddNode("a");
+        var b = root.GetOrAddNode("b");
+        var c = root.GetOrAddNode("c");
+        _ = root.GetOrAddEdge(a, b);
+        _ = root.GetOrAddEdge(b, c);
+        var x = root.GetOrAddSubgraph("cluster_x");
+        x.SafeSetAttribute("label", "X", "");
+        x.AddExisting(a);
+        x.AddExisting(c);
+        x.GetOrAddSubgraph("cluster_y").AddExisting(c);
+        root.GetOrAddSubgraph("cluster_z").AddExisting(b);
+
+        var result = root.AddSubgraphFromNodes("sel", new[] { a, b });
+        Assert.AreEqual(2, result.Nodes().Count());
+        Assert.AreEqual(1, result.Edges().Count());
+        Assert.AreEqual(new[] { "sel:cluster_x", "sel:cluster_z" }, result.Children().Select(s => s.GetName()).OrderBy(n => n).ToArray());
+
+        var filteredX = result.GetSubgraph("sel:cluster_x")!;
+        Assert.AreEqual("X", filteredX.GetAttribute("label"));
+        Assert.IsTrue(filteredX.Contains(a));
+        Assert.IsFalse(filteredX.Contains(c));
+        // Subgraphs without selected nodes are left out
+        Assert.AreEqual(0, filteredX.Children().Count());
+    }
+
+    [Test()]
+    public void TestSafeDeleteSubgraphs()
+    {
+        var root = Utils.CreateUniqueTestGraph();
+        var node = root.GetOrAddNode("a");
+        for (int i = 0; i < 100; i++)
+        {
+            var parent = root.GetOrAddSubgraph("parent" + i);
+            var child = parent.GetOrAddSubgraph("child" + i);
+            _ = child.GetOrAddSubgraph("grandchild" + i);
+            if (i % 2 == 0)
+                child.AddExisting(node);
+        }
+        Assert.AreEqual(300, root.Descendants().Count());
+
+        // A parent becomes childless once its empty child is deleted
+        root.SafeDeleteSubgraphs(s => !s.Nodes().Any() && !s.Children().Any());
+        Assert.AreEqual(100, root.Descendants().Count());
+        Assert.IsNull(root.GetSubgraph("parent1"));
+
+        // Subgraphs that are deleted along with an ancestor may be listed as well
+        var parent0 = root.GetSubgraph("parent0")!;
+        root.SafeDeleteSubgraphs(new[] { parent0, parent0.GetSubgraph("child0")! });
+        Assert.AreEqual(98, root.Descendants().Count());
+
+        _ = Assert.Throws<InvalidOperationException>(() => root.SafeDeleteSubgraphs(s => throw new InvalidOperationException()));
+
+        // A parent is deleted before its child, whose deletion would otherwise change the answer for the parent
+        var nested = Utils.CreateUniqueTestGraph();
+        _ = nested.GetOrAddSubgraph("outer").GetOrAddSubgraph("inner");
+        _ = nested.GetOrAddSubgraph("single");
+        nested.SafeDeleteSubgraphs(s => s.Children().Any());
+        Assert.AreEqual(new[] { "single" }, nested.Descendants().Select(s => s.GetName()).ToArray());
+    }
+
+    [Test()]
+    public void TestGetDescendantByName()
+    {
+        var root = RootGraph.FromDotString("digraph { subgraph cluster_a { subgraph cluster_b { x } } subgraph cluster_c { y } }");
+        var a = root.GetDescendantByName("cluster_a")!;
+        Assert.AreEqual("cluster_b", root.GetDescendantByName("cluster_b")!.GetName());
+        Assert.IsNull(root.GetDescendantByName("cluster_d"));
+
+        // The index follows subgraphs that are added and deleted after it was built
+        var c = root.GetDescendantByName("cluster_c")!;
+        var d = c.GetOrAddSubgraph("cluster_d");
+        Assert.AreEqual(d, root.GetDescendantByName("cluster_d"));
+        // Only descendants of the graph itself are found
+        Assert.IsNull(a.GetDescendantByName("cluster_d"));
+        Assert.IsNull(d.GetDescendantByName("cluster_d"));
+        var duplicate = a.GetOrAddSubgraph("cluster_d");
+        Assert.AreEqual(duplicate, a.GetDescendantByName("cluster_d"));
+
+        c.Delete();
+        Assert.AreEqual(duplicate, root.GetDescendantByName("cluster_d"));
+        Assert.IsNull(root.GetDescendantByName("cluster_c"));
+        root.Close();
+
+        var other = RootGraph.FromDotString("digraph { subgraph cluster_a { } }");
+        Assert.IsNotNull(other.GetDescendantByName("cluster_a"));
+    }
+
+    [Test()]
+    public void TestGraphBuilder()
+    {
+        var builder = new GraphBuilder(name: "built");
+        int a = builder.AddNode("a");
+        Assert.AreEqual(a, builder.AddNode("a"));
+        int ab = builder.AddEdge("a", "b", "named");
+        _ = builder.AddEdge(a, builder.AddNode("b"));
+        _ = builder.AddEdge("b", "c");
+        Assert.AreEqual(3, builder.NodeCount);
+        Assert.AreEqual(3, builder.EdgeCount);
+        _ = Assert.Throws<ArgumentOutOfRangeException>(() => builder.AddEdge(a, 3));
+
+        builder.SetNodeAttributeColumn("label", new[] { "A", "", "C" }, "default");
+        builder.SetEdgeAttributeColumn("color", new[] { "red", "green", "blue" });
+        var root = builder.Build();
+        Assert.AreEqual("built", root.GetName());
+        Assert.AreEqual("abc", string.Concat(root.Nodes().Select(n => n.GetName())));
+        Assert.AreEqual(3, root.Edges().Count());
+        Assert.AreEqual("A", root.GetNode("a")!.GetAttribute("label"));
+        Assert.AreEqual("", root.GetNode("b")!.GetAttribute("label"));
+        Assert.AreEqual("default", root.GetOrAddNode("d").GetAttribute("label"));
+
+        var named = root.GetEdge(root.GetNode("a")!, root.GetNode("b")!, "named")!;
+        Assert.AreEqual("red", named.GetAttribute("color"));
+        Assert.AreEqual("blue", root.GetNode("b")!.EdgesOut().Single().GetAttribute("color"));
+        Assert.AreEqual(0, ab);
+
+        // Columns must cover every element
+        builder.SetNodeAttributeColumn("shape", new[] { "box" });
+        _ = Assert.Throws<InvalidOperationException>(() => builder.Build());
+
+        // The tables are checked before they reach graphviz
+        var (data, offsets) = FFI.Marshaling.MarshalColumnToUtf8(new[] { "a", "b" });
+        RootGraph fromTables(int[] tails, int[] heads, int[] edgeNames, int[] kinds) => RootGraph.CreateFromTables(
+            null, GraphType.Directed, data, offsets, 2, 0, tails, heads, edgeNames, kinds, CoordinateSystem.BottomLeft);
+        Assert.AreEqual(1, fromTables(new[] { 0 }, new[] { 1 }, new[] { -1 }, new int[0]).Edges().Count());
+        _ = Assert.Throws<ArgumentOutOfRangeException>(() => fromTables(new[] { 0 }, new[] { 2 }, new[] { -1 }, new int[0]));
+        _ = Assert.Throws<ArgumentOutOfRangeException>(() => fromTables(new[] { -1 }, new[] { 1 }, new[] { -1 }, new int[0]));
+        _ = Assert.Throws<ArgumentOutOfRangeException>(() => fromTables(new[] { 0 }, new[] { 1 }, new[] { 0 }, new int[0]));
+        _ = Assert.Throws<ArgumentOutOfRangeException>(() => fromTables(new int[0], new int[0], new int[0], new[] { 3 }));
+        _ = Assert.Throws<ArgumentException>(() => fromTables(new int[0], new int[0], new int[0], new[] { 1 }));
+    }
+
+    [Test()]
+    public void TestTraversals()
+    {
+        var root = Utils.CreateUniqueTestGraph();
+        var nodes = new[] { "a", "b", "c", "d", "e" }.Select(root.GetOrAddNode).ToArray();
+        string names(IEnumerable<Node> ns) => string.Concat(ns.Select(n => n.GetName()));
+        var ab = root.GetOrAddEdge(nodes[0], nodes[1]);
+        _ = root.GetOrAddEdge(nodes[0], nodes[2]);
+        _ = root.GetOrAddEdge(nodes[1], nodes[3]);
+        _ = root.GetOrAddEdge(nodes[2], nodes[3]);
+
+        Assert.AreEqual("abcd", names(root.BreadthFirst(nodes[0])));
+        Assert.AreEqual("abdc", names(root.DepthFirst(nodes[0])));
+        Assert.AreEqual("dbca", names(root.DepthFirst(nodes[0], postOrder: true)));
+        Assert.AreEqual("dbca", names(root.BreadthFirst(nodes[3], TraversalDirection.In)));
+        Assert.AreEqual("e", names(root.BreadthFirst(nodes[4], TraversalDirection.Both)));
+        Assert.AreEqual("aebcd", names(root.TopologicalSort()));
+
+        var distances = root.Distances(nodes[0]);
+        Assert.AreEqual(4, distances.Count);
+        Assert.AreEqual(0, distances[nodes[0]]);
+        Assert.AreEqual(2, distances[nodes[3]]);
+
+        // Traversals only follow the edges of the graph they are called on
+        var sub = root.GetOrAddSubgraph("sub");
+        sub.AddExisting(ab);
+        sub.AddExisting(nodes[3]);
+        _ = Assert.Throws<ArgumentException>(() => sub.BreadthFirst(nodes[2]));
+        Assert.AreEqual("ab", names(sub.BreadthFirst(nodes[0])));
+
+        _ = root.GetOrAddEdge(nodes[3], nodes[0]);
+        _ = Assert.Throws<InvalidOperationException>(() => root.TopologicalSort());
+    }
+
+    [Test()]
+    public void TestFingerprint()
+    {
+        var attributes = new[] { "shape", "label" };
+        RootGraph build(bool reversed)
+        {
+            var root = Utils.CreateUniqueTestGraph();
+            Node.IntroduceAttribute(root, "shape", "box");
+            Node.IntroduceAttribute(root, "color", "black");
+            var names = new[] { "a", "b", "c" };
+            var nodes = (reversed ? names.Reverse() : names).Select(root.GetOrAddNode).ToList();
+            var a = root.GetNode("a")!;
+            foreach (var node in nodes.Where(n => !n.Equals(a)))
+                _ = root.GetOrAddEdge(a, node, "to_" + node.GetName());
+            var sub = root.GetOrAddSubgraph("cluster_x");
+            sub.AddExisting(a);
+            return root;
+        }
+
+        var first = build(false);
+        var second = build(true);
+        var fingerprint = first.ComputeFingerprint(attributes);
+        Assert.AreEqual(fingerprint, second.ComputeFingerprint(attributes));
+        Assert.AreEqual(fingerprint, GraphFingerprint.Parse(fingerprint.ToString()));
+
+        // Attributes that are not part of the fingerprint do not matter
+        second.GetNode("b")!.SetAttribute("color", "red");
+        Assert.AreEqual(fingerprint, second.ComputeFingerprint(attributes));
+
+        second.GetNode("b")!.SetAttribute("shape", "circle");
+        Assert.AreNotEqual(fingerprint, second.ComputeFingerprint(attributes));
+        second.GetNode("b")!.SetAttribute("shape", "box");
+        Assert.AreEqual(fingerprint, second.ComputeFingerprint(attributes));
+
+        second.GetSubgraph("cluster_x")!.AddExisting(second.GetNode("b")!);
+        Assert.AreNotEqual(fingerprint, second.ComputeFingerprint(attributes));
+
+        _ = first.GetOrAddEdge(first.GetNode("b")!, first.GetNode("c")!);
+        Assert.AreNotEqual(fingerprint, first.ComputeFingerprint(attributes));
+
+        // Anonymous subgraphs are named after a process wide counter, so their names differ between
+        // two parses of the same input, and the fingerprint must not depend on them
+        const string dot = "digraph { a -> b; { rank=same; b; c; b -> c } { rank=same; d } }";
+        var rankAttributes = new[] { "rank" };
+        var parsed = RootGraph.FromDotString(dot).ComputeFingerprint(rankAttributes);
+        _ = RootGraph.FromDotString("digraph { { x } }");
+        Assert.AreEqual(parsed, RootGraph.FromDotString(dot).ComputeFingerprint(rankAttributes));
+        Assert.AreEqual(parsed, RootGraph.FromDotString(
+            "digraph { a -> b; { rank=same; d } { rank=same; c; b; b -> c } }").ComputeFingerprint(rankAttributes));
+        Assert.AreNotEqual(parsed, RootGraph.FromDotString(
+            "digraph { a -> b; { rank=same; b; c; b -> c } { rank=same; d; a } }").ComputeFingerprint(rankAttributes));
+    }
+
+    [Test()]
+    public void TestAttributeColumns()
+    {
+        RootGraph root = Utils.CreateUniqueTestGraph();
+        for (int i = 0; i < 5; i++)
+            _ = root.GetOrAddNode(i.ToString());
+        var nodes = root.Nodes().ToList();
+        for (int i = 1; i < nodes.Count; i++)
+            _ = root.GetOrAddEdge(nodes[i - 1], nodes[i]);
+
+        var label = Node.GetAttributeHandle(root, "label", "none");
+        Assert.AreEqual(Enumerable.Repeat("none", 5), root.GetNodeAttributeColumn(label));
+
+        var values = nodes.Select(n => $"näme {n.GetName()}").ToList();
+        root.SetNodeAttributeColumn(label, values);
+        Assert.AreEqual(values, nodes.Select(n => n.GetAttribute("label")));
+        Assert.AreEqual(values, root.GetNodeAttributeColumn(label));
+
+        var weight = Edge.GetAttributeHandle(root, "weight", "1");
+        var edges = root.Edges().ToList();
+        root.SetEdgeAttributeColumn(weight, new[] { "1", "2", "3", "" });
+        Assert.AreEqual(new[] { "1", "2", "3", "" }, edges.Select(e => e.GetAttribute("weight")));
+        Assert.AreEqual(new[] { "1", "2", "3", "" }, root.GetEdgeAttributeColumn(weight));
+
+        _ = Assert.Throws<ArgumentException>(() => root.SetNodeAttributeColumn(label, new[] { "too few" }));
+        Assert.AreEqual(values, root.GetNodeAttributeColumn(label));
+        _ = Assert.Throws<ArgumentException>(() => root.GetEdgeAttributeColumn(label));
+
+        var sub = root.GetOrAddSubgraph("sub");
+        sub.AddExisting(nodes[0]);
+        Assert.AreEqual(new[] { values[0] }, sub.GetNodeAttributeColumn(label));
+    }
+
+    [Test()]
+    public void TestWriteDot()
+    {
+        // Large enough to span multiple native chunks
+        RootGraph root = Utils.CreateRandomConnectedGraph(5000, 3);
+        Node.IntroduceAttribute(root, "label", "");
+        root.GetNode("0")!.SetAttribute("label", "Ünïcødé");
+
+        using var stream = new System.IO.MemoryStream();
+        root.WriteDot(stream);
+        Assert.Greater(stream.Length, 1 << 16);
+        Assert.AreEqual(root.ToDotString(), System.Text.Encoding.UTF8.GetString(stream.ToArray()));
+
+        var closed = new System.IO.MemoryStream();
+        closed.Dispose();
+        _ = Assert.Throws<ObjectDisposedException>(() => root.WriteDot(closed));
+    }
+
+    [Test()]
+    public void TestSetAttributeWithoutAllocating()
+    {
+        RootGraph root = Utils.CreateUniqueTestGraph();
+        Node node = root.GetOrAddNode("1");
+        var labels = Enumerable.Range(0, 100).Select(i => $"label {i} ✅").ToList();
+        // Warm up, so the measurement below does not include one-time allocations
+        node.SetAttribute("label", labels[0]);
+        node.SafeSetAttribute("color", labels[0], "black");
+
+        long before = GC.GetAllocatedBytesForCurrentThread();
+        foreach (var label in labels)
+        {
+            node.SetAttribute("label", label);
+            node.SafeSetAttribute("color", label, "black");
+        }
+        long allocated = GC.GetAllocatedBytesForCurrentThread() - before;
+        // Allowing for incidental allocations of the runtime, such as tiered compilation. Encoding the
+        // arguments into new arrays would take well over 16 bytes for every call.
+        Assert.Less(allocated, 2 * labels.Count * 16);
+        Assert.AreEqual(labels.Last(), node.GetAttribute("label"));
+
+        // Strings that do not fit the reusable buffer
+        var longLabel = new string('✅', 100000);
+        node.SetAttribute("label", longLabel);
+        Assert.AreEqual(longLabel, node.GetAttribute("label"));
+    }
+
     [Test()]
     public void TestDeletions()
     {
@@ -14,6 +14,36 @@ public void TestUniqueGraphs()
         Assert.AreNotEqual(g1, g2);
     }
 
+    [Test()]
+    public void TestReadDotStringWithCrLf()
+    {
+        // Large enough to span multiple reads by the parser, such that line endings cross read boundaries
+        var builder = new System.Text.StringBuilder("digraph test {\r\n");
+        for (int i = 0; i < 5000; i++)
+            _ = builder.Append($"    n{i} [label = \"line \\\r\ncontinued {i}\"];\r\n");
+        _ = builder.Append("    lonecr [label = \"a\rb\"];\r\n}\r\n");
+
+        RootGraph root = RootGraph.FromDotString(builder.ToString());
+        Assert.AreEqual(5001, root.Nodes().Count());
+        Assert.AreEqual("line continued 4999", root.GetNode("n4999")!.GetAttribute("label"));
+        Assert.AreEqual("a\rb", root.GetNode("lonecr")!.GetAttribute("label"));
+    }
+
+    [TestCase("utf-8")]
+    [TestCase("utf-16")]
+    public void TestReadDotFileEncodings(string encodingName)
+    {
+        var encoding = System.Text.Encoding.GetEncoding(encodingName);
+        var path = TestContext.CurrentContext.TestDirectory + $"/encoding-{encodingName}.gv";
+        var dot = "digraph test {\r\n    \"Ünïcødé\" [label = \"multi \\\r\nline\"];\r\n    A -> B;\r\n}\r\n";
+        // Both encodings write a byte order mark
+        System.IO.File.WriteAllText(path, dot, encoding);
+
+        var root = RootGraph.FromDotFile(path);
+        Assert.AreEqual(3, root.Nodes().Count());
+        Assert.AreEqual("multi line", root.GetNode("Ünïcødé")!.GetAttribute("label"));
+    }
+
     [Test()]
     public void TestReadDotFile()
     {
@@ -1,5 +1,8 @@
+using System;
 using System.Collections.Generic;
+using System.IO;
 using System.Linq;
+using System.Threading.Tasks;
 using NUnit.Framework;
 
 namespace Rubjerg.Graphviz.Test;
@@ -60,6 +63,162 @@ public void TestTopologicalEqualsCloneWithSubgraphs(int nodes, int degree)
         Assert.IsFalse(GraphComparer.CheckTopologicallyEquals(sub3, sub2, Log));
     }
 
+    [Test()]
+    public void TestCloneKeepsHierarchyAndAttributes()
+    {
+        var root = Utils.CreateUniqueTestGraph();
+        Node.IntroduceAttribute(root, "color", "black");
+        Edge.IntroduceAttribute(root, "weight", "1");
+        Graph.IntroduceAttribute(root, "label", "");
+        var a = root.GetOrAddNode("a");
+        var b = root.GetOrAddNode("b");
+        a.SetAttribute("color", "red");
+        _ = root.GetOrAddEdge(a, b);
+        var e2 = root.GetOrAddEdge(a, b);
+        var named = root.GetOrAddEdge(b, a, "named");
+        e2.SetAttribute("weight", "5");
+
+        var outer = root.GetOrAddSubgraph("outer");
+        outer.SetAttribute("label", "outer label");
+        var inner = outer.GetOrAddSubgraph("inner");
+        inner.AddExisting(a);
+        inner.AddExisting(b);
+        inner.AddExisting(e2);
+        inner.AddExisting(named);
+
+        var clone = root.Clone("clone");
+        Assert.IsTrue(GraphComparer.CheckTopologicallyEquals(root, clone, Log));
+        Assert.AreEqual(3, clone.Edges().Count());
+        Assert.AreEqual("red", clone.GetNode("a")!.GetAttribute("color"));
+        Assert.AreEqual("black", clone.GetNode("b")!.GetAttribute("color"));
+        Assert.That(clone.Edges().Select(e => e.GetAttribute("weight")), Is.EquivalentTo(new[] { "1", "5", "1" }));
+        Assert.IsNotNull(clone.GetEdge(clone.GetNode("b")!, clone.GetNode("a")!, "named"));
+
+        var clonedOuter = clone.GetSubgraph("outer")!;
+        Assert.AreEqual("outer label", clonedOuter.GetAttribute("label"));
+        var clonedInner = clonedOuter.GetSubgraph("inner")!;
+        Assert.AreEqual("outer", clonedInner.Parent().GetName());
+        Assert.AreEqual(2, clonedInner.Nodes().Count());
+        Assert.That(clonedInner.Edges().Select(e => e.GetAttribute("weight")), Is.EquivalentTo(new[] { "5", "1" }));
+
+        // Cloning a subgraph into an existing graph reuses the nodes that are already there
+        var target = Utils.CreateUniqueTestGraph();
+        var existing = target.GetOrAddNode("a");
+        outer.CloneInto(target);
+        Assert.AreEqual(2, target.Nodes().Count());
+        Assert.IsTrue(existing.Equals(target.GetNode("a")));
+        Assert.AreEqual("red", existing.GetAttribute("color"));
+        Assert.IsNotNull(target.GetSubgraph("inner"));
+    }
+
+    [Test()]
+    public void TestSnapshotRoundTrip()
+    {
+        var root = CreateRandomConnectedGraph(10 * SizeMultiplier, 5);
+        Node.IntroduceAttribute(root, "color", "black");
+        Edge.IntroduceAttribute(root, "weight", "1");
+        Node.IntroduceAttributeHtml(root, "label", "<b>default</b>");
+        var first = root.Nodes().First();
+        first.SetAttribute("color", "red");
+        root.Edges().Last().SetAttribute("weight", "5");
+        var outer = root.AddSubgraphFromNodes("outer", root.Nodes().Take(5));
+        outer.SetAttribute("label", "outer label");
+        _ = outer.AddSubgraphFromNodes("inner", outer.Nodes().Take(2));
+
+        // The snapshot does not have to start at the beginning of the stream
+        using var stream = new MemoryStream();
+        stream.WriteByte(42);
+        root.SaveSnapshot(stream);
+        stream.Position = 1;
+        var loaded = RootGraph.LoadSnapshot(stream);
+        Assert.AreEqual(stream.Length, stream.Position);
+        Assert.AreEqual(root.GetName(), loaded.GetName());
+        Assert.IsTrue(GraphComparer.CheckTopologicallyEquals(root, loaded, Log));
+        Assert.AreEqual(0, GraphComparer.Compare(root, loaded, compareAttributes: true).Count);
+        Assert.AreEqual(root.ToDotString(), loaded.ToDotString());
+        Assert.AreEqual("red", loaded.GetNode(first.GetName())!.GetAttribute("color"));
+
+        var loadedInner = loaded.GetSubgraph("outer")!.GetSubgraph("inner")!;
+        Assert.AreEqual(2, loadedInner.Nodes().Count());
+        Assert.AreEqual(outer.GetSubgraph("inner")!.Edges().Count(), loadedInner.Edges().Count());
+
+        // A snapshot of a subgraph is read back as a root graph
+        using var subStream = new MemoryStream();
+        outer.SaveSnapshot(subStream);
+        subStream.Position = 0;
+        var loadedOuter = RootGraph.LoadSnapshot(subStream);
+        Assert.IsTrue(GraphComparer.CheckTopologicallyEquals(outer, loadedOuter, Log));
+        Assert.AreEqual("outer label", loadedOuter.GetAttribute("label"));
+
+        // Stored defaults apply to nodes that are added later, also for attributes that every graph declares
+        Assert.AreEqual("<b>default</b>", loaded.GetOrAddNode("added").GetAttribute("label"));
+
+        var truncated = stream.ToArray().Skip(1).Take((int)stream.Length - 2).ToArray();
+        _ = Assert.Throws<InvalidDataException>(() => RootGraph.LoadSnapshot(new MemoryStream(truncated)));
+        _ = Assert.Throws<InvalidDataException>(() => RootGraph.LoadSnapshot(new MemoryStream(new byte[] { 1, 2, 3 })));
+    }
+
+    [Test()]
+    public void TestGraphComparerDifferences()
+    {
+        var A = Utils.CreateUniqueTestGraph();
+        var B = Utils.CreateUniqueTestGraph();
+        Node.IntroduceAttribute(A, "color", "black");
+        Node.IntroduceAttribute(B, "color", "black");
+        var aA = A.GetOrAddNode("a");
+        var bA = A.GetOrAddNode("b");
+        _ = A.GetOrAddNode("c");
+        _ = A.GetOrAddEdge(aA, bA, "x");
+        _ = A.GetOrAddEdge(aA, bA);
+        _ = A.GetOrAddEdge(bA, aA);
+        aA.SetAttribute("color", "red");
+        var aB = B.GetOrAddNode("a");
+        var bB = B.GetOrAddNode("b");
+        var dB = B.GetOrAddNode("d");
+        _ = B.GetOrAddEdge(aB, dB, "x");
+        _ = B.GetOrAddEdge(aB, bB);
+        _ = B.GetOrAddEdge(bB, aB);
+        aB.SetAttribute("color", "blue");
+
+        var differences = GraphComparer.Compare(A, B);
+        Assert.AreEqual(4, differences.Count);
+        Assert.IsTrue(differences.Any(d => d.Kind == GraphDifferenceKind.MissingNode && d.MissingIn == "B" && d.NodeName == "c"));
+        Assert.IsTrue(differences.Any(d => d.Kind == GraphDifferenceKind.MissingNode && d.MissingIn == "A" && d.NodeName == "d"));
+        Assert.IsTrue(differences.Any(d => d.Kind == GraphDifferenceKind.EdgeEndpointMismatch && d.MissingIn == "B"
+            && d.NodeName == "a" && d.HeadName == "b" && d.EdgeName == "x"));
+        Assert.IsTrue(differences.Any(d => d.Kind == GraphDifferenceKind.EdgeEndpointMismatch && d.MissingIn == "A"
+            && d.NodeName == "a" && d.HeadName == "d" && d.EdgeName == "x"));
+        Assert.IsFalse(GraphComparer.CheckTopologicallyEquals(A, B, Log));
+
+        var attributeDifference = GraphComparer.Compare(A, B, compareAttributes: true)
+            .Single(d => d.Kind == GraphDifferenceKind.AttributeMismatch);
+        Assert.AreEqual("a", attributeDifference.NodeName);
+        Assert.AreEqual("color", attributeDifference.AttributeName);
+        Assert.AreEqual("red", attributeDifference.ValueA);
+        Assert.AreEqual("blue", attributeDifference.ValueB);
+    }
+
+    [TestCase(20000)]
+    public void TestGraphComparerHubNode(int degree)
+    {
+        var root = Utils.CreateUniqueTestGraph();
+        var hub = root.GetOrAddNode("hub");
+        for (int i = 0; i < degree; i++)
+        {
+            var node = root.GetOrAddNode($"n{i}");
+            _ = root.GetOrAddEdge(hub, node, $"e{i}");
+            _ = root.GetOrAddEdge(node, hub);
+        }
+        var clone = root.Clone("clone");
+        Assert.AreEqual(0, GraphComparer.Compare(root, clone, compareAttributes: true).Count);
+
+        clone.Delete(clone.GetEdge(clone.GetNode("hub")!, clone.GetNode("n0")!, "e0")!);
+        var difference = GraphComparer.Compare(root, clone).Single();
+        Assert.AreEqual(GraphDifferenceKind.MissingEdge, difference.Kind);
+        Assert.AreEqual("B", difference.MissingIn);
+        Assert.AreEqual("e0", difference.EdgeName);
+    }
+
     /// <summary>
     /// This test fails if the locking doesn't work, and the GC runs async.
     /// </summary>
@@ -84,6 +243,76 @@ public void TestGetNode(int initial_graphs, int get_attempts)
         }
     }
 
+    /// <summary>
+    /// Build and inspect independent graphs from many threads at once, while the GC is closing
+    /// the graphs of earlier iterations. This test fails if the per root graph locking is incomplete.
+    /// </summary>
+    [TestCase(16, 20, 50)]
+    [NonParallelizable]
+    public void TestParallelRootGraphs(int threads, int iterations, int nodes)
+    {
+        // Other tests have used graphviz already, so the mode can only be switched by force
+        var previousMode = RootGraph.LockingMode;
+        var otherMode = previousMode == LockingMode.Global ? LockingMode.PerRootGraph : LockingMode.Global;
+        _ = RootGraph.CreateNew(GraphType.Directed, "freeze").GetOrAddNode("a");
+        _ = Assert.Throws<InvalidOperationException>(() => RootGraph.LockingMode = otherMode);
+        RootGraph.LockingMode = previousMode;
+        FFI.GraphvizFFI.ResetLockingMode(LockingMode.PerRootGraph);
+        try
+        {
+            _ = Parallel.For(0, threads, new ParallelOptions { MaxDegreeOfParallelism = threads }, t =>
+            {
+                for (int i = 0; i < iterations * SizeMultiplier; i++)
+                {
+                    var root = RootGraph.CreateNew(GraphType.Directed, $"graph{t}_{i}");
+                    Node.IntroduceAttribute(root, "label", "");
+                    for (int n = 0; n < nodes; n++)
+                    {
+                        var node = root.GetOrAddNode(n.ToString());
+                        node.SetAttribute("label", $"{t}_{n}");
+                        if (n > 0)
+                        {
+                            // Anonymous edges are numbered from a counter that is shared by all graphs
+                            _ = root.GetOrAddEdge(root.GetNode((n - 1).ToString())!, node);
+                            _ = root.GetOrAddEdge(node, root.GetNode((n / 2).ToString())!);
+                        }
+                    }
+
+                    Assert.AreEqual(nodes, root.Nodes().Count());
+                    Assert.AreEqual(2 * (nodes - 1), root.Edges().Count());
+                    Assert.AreEqual($"{t}_{nodes - 1}", root.GetNode((nodes - 1).ToString())!.GetAttribute("label"));
+
+                    // Named subgraphs get their id from their root graph, anonymous ones from the shared counter
+                    var named = root.GetOrAddSubgraph($"cluster{t}_{i}");
+                    var anonymous = SubGraph.GetOrCreate(root, null);
+                    named.AddExisting(root.GetNode("0")!);
+                    anonymous.AddExisting(root.GetNode("1")!);
+                    Assert.AreEqual(2, root.Descendants().Count());
+                    Assert.AreEqual(1, root.Descendants().Count(s => s.GetName()!.StartsWith("%", StringComparison.Ordinal)));
+                    anonymous.Delete();
+                    root.SafeDeleteSubgraphs(new[] { named });
+                    Assert.AreEqual(0, root.Descendants().Count());
+
+                    var clone = root.Clone($"clone{t}_{i}");
+                    Assert.IsTrue(GraphComparer.CheckTopologicallyEquals(root, clone, _ => { }));
+
+                    var parsed = RootGraph.FromDotString(root.ToDotString());
+                    Assert.AreEqual(nodes, parsed.Nodes().Count());
+
+                    if (i % 5 == 0)
+                        GC.Collect();
+                }
+            });
+        }
+        finally
+        {
+            // Close the graphs of this test in the mode they were created in, before restoring the mode
+            GC.Collect();
+            GC.WaitForPendingFinalizers();
+            FFI.GraphvizFFI.ResetLockingMode(previousMode);
+        }
+    }
+
     [TestCase(500, 10)]
     public void TestAddNode(int nodes, int degree)
     {
@@ -148,4 +377,21 @@ public void TestBFS(int nodes, int degree)
         Log($"Elapsed ms: {elapsedms}");
         Assert.AreEqual(initcount, visited.Count);
     }
+
+    [TestCase(100, 10)]
+    public void TestNativeBFS(int nodes, int degree)
+    {
+        int initcount = nodes * SizeMultiplier;
+        var root = CreateRandomConnectedGraph(initcount, degree);
+        var watch = System.Diagnostics.Stopwatch.StartNew();
+
+        var start = root.GetOrAddNode(0.ToString());
+        var visited = root.BreadthFirst(start);
+
+        watch.Stop();
+        var elapsedms = watch.ElapsedMilliseconds;
+        Log($"Elapsed ms: {elapsedms}");
+        Assert.AreEqual(initcount, visited.Length);
+        Assert.AreEqual(initcount, root.DepthFirst(start).Distinct().Count());
+    }
 }
@@ -1,6 +1,8 @@
 using System.Drawing;
 using System.IO;
 using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
 using NUnit.Framework;
 using static Rubjerg.Graphviz.Test.Utils;
 
@@ -84,6 +86,61 @@ public void TestLayoutMethodsWithInProcessLayout()
         Assert.AreNotEqual(edge.GetTailLabelDrawing().Count, 0);
     }
 
+    [Test()]
+    public void TestRenderToBytes()
+    {
+        CreateSimpleTestGraph(out RootGraph root, out _, out _);
+        _ = Assert.Throws<System.ApplicationException>(() => root.RenderToBytes("svg"));
+
+        root.ComputeLayout();
+        string svg = GraphvizCommand.ConvertBytesOutputToString(root.RenderToBytes("svg"));
+        Assert.That(svg, Does.Contain("<svg"));
+        Assert.That(svg, Does.Contain("</svg>"));
+
+        using (var stream = new MemoryStream())
+        {
+            root.RenderToStream(stream, "png");
+            var png = stream.ToArray();
+            // The PNG signature
+            Assert.AreEqual(new byte[] { 0x89, 0x50, 0x4E, 0x47 }, png.Take(4).ToArray());
+        }
+
+        _ = Assert.Throws<System.ApplicationException>(() => root.RenderToBytes("bogus"));
+        root.FreeLayout();
+    }
+
+    [Test()]
+    public void TestContextPool()
+    {
+        using (var pool = new GraphvizContextPool(size: 1, maxLayoutsPerContext: 2))
+        {
+            RootGraph.ContextPool = pool;
+            try
+            {
+                var graphs = Enumerable.Range(0, 3).Select(i =>
+                {
+                    CreateSimpleTestGraph(out RootGraph root, out Node nodeA, out _);
+                    root.ComputeLayout();
+                    Assert.AreNotEqual(default(PointD), nodeA.GetPosition());
+                    return root;
+                }).ToList();
+
+                // The third layout exceeds the limit of the first context
+                Assert.AreEqual(2, pool.ContextsCreated);
+                Assert.AreEqual(1, pool.ContextsRecycled);
+
+                // A recycled context is kept until its layouts are freed
+                Assert.That(GraphvizCommand.ConvertBytesOutputToString(graphs[0].RenderToBytes("svg")), Does.Contain("<svg"));
+                foreach (var graph in graphs)
+                    graph.FreeLayout();
+            }
+            finally
+            {
+                RootGraph.ContextPool = null;
+            }
+        }
+    }
+
     [Test()]
     public void TestLayoutMethodsWithLayout()
     {
@@ -115,6 +172,221 @@ public void TestLayoutMethodsWithLayout()
         Assert.AreNotEqual(xedge.GetTailLabelDrawing().Count, 0);
     }
 
+    [Test()]
+    public void TestLayoutWithWorkerPool()
+    {
+        using var pool = new GraphvizWorkerPool(1);
+        // The same worker process is reused for subsequent layouts
+        for (int i = 0; i < 3; i++)
+        {
+            CreateSimpleTestGraph(out RootGraph root, out _, out _);
+            var xroot = pool.CreateLayout(root);
+            var xnodeA = xroot.GetNode("A");
+            Assert.AreEqual(2, xroot.Nodes().Count());
+            Assert.AreNotEqual(xroot.GetBoundingBox(), default(RectangleD));
+            Assert.AreEqual(xnodeA.GetRecordRectangles().Count(), 2);
+        }
+
+        // Switching engines replaces the worker
+        CreateSimpleTestGraph(out RootGraph neatoRoot, out _, out _);
+        var xneatoRoot = pool.CreateLayout(neatoRoot, LayoutEngines.Neato);
+        Assert.AreEqual(2, xneatoRoot.Nodes().Count());
+
+        pool.Dispose();
+        _ = Assert.Throws<System.ObjectDisposedException>(() => pool.CreateLayout(neatoRoot));
+    }
+
+    [Test()]
+    public void TestLayoutCache()
+    {
+        string directory = Path.Combine(Path.GetTempPath(), "layoutcache-" + System.Guid.NewGuid().ToString("N"));
+        int computed = 0;
+        (string, string) compute(Graph graph, string engine)
+        {
+            computed++;
+            var (stdout, stderr) = GraphvizCommand.Exec(graph, engine: engine);
+            return (GraphvizCommand.ConvertBytesOutputToString(stdout), stderr);
+        }
+
+        try
+        {
+            var cache = new LayoutCache(directory: directory);
+            CreateSimpleTestGraph(out RootGraph root, out Node nodeA, out _);
+            var first = cache.CreateLayout(root, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            var second = cache.CreateLayout(root, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            Assert.AreEqual(1, computed);
+            Assert.AreEqual(1, cache.Hits);
+            Assert.AreEqual(1, cache.Misses);
+            Assert.Greater(cache.MemoryBytes, 0);
+            Assert.Greater(cache.DiskBytes, 0);
+            Assert.AreEqual(first.GetBoundingBox(), second.GetBoundingBox());
+            Assert.AreEqual(2, second.GetNode("A")!.GetRecordRectangles().Count());
+
+            // Other engines and changed attributes result in a different key
+            _ = cache.CreateLayout(root, LayoutEngines.Neato, CoordinateSystem.BottomLeft, compute);
+            nodeA.SetAttribute("label", "{a|b|c}");
+            var changed = cache.CreateLayout(root, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            Assert.AreEqual(3, computed);
+            Assert.AreEqual(3, changed.GetNode("A")!.GetRecordRectangles().Count());
+
+            // A new cache that shares the directory finds the layouts on disk
+            var other = new LayoutCache(maxMemoryBytes: 0, directory: directory);
+            Assert.AreEqual(cache.DiskBytes, other.DiskBytes);
+            _ = other.CreateLayout(root, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            Assert.AreEqual(3, computed);
+            Assert.AreEqual(1, other.DiskHits);
+            Assert.AreEqual(0, other.MemoryBytes);
+
+            cache.Clear();
+            Assert.AreEqual(0, cache.DiskBytes);
+            Assert.AreEqual(0, cache.MemoryBytes);
+        }
+        finally
+        {
+            Directory.Delete(directory, true);
+        }
+    }
+
+    [Test()]
+    public void TestLayoutCacheParsedInput()
+    {
+        string directory = Path.Combine(Path.GetTempPath(), "layoutcache-" + System.Guid.NewGuid().ToString("N"));
+        int computed = 0;
+        (string, string) compute(Graph graph, string engine)
+        {
+            computed++;
+            var (stdout, stderr) = GraphvizCommand.Exec(graph, engine: engine);
+            return (GraphvizCommand.ConvertBytesOutputToString(stdout), stderr);
+        }
+
+        try
+        {
+            // Anonymous subgraphs get different names every time the input is parsed
+            const string dot = "digraph { A -> B; { rank=same; B; C } }";
+            var cache = new LayoutCache(directory: directory);
+            var first = RootGraph.FromDotString(dot);
+            var second = RootGraph.FromDotString(dot);
+            string key = cache.CreateKey(first, LayoutEngines.Dot);
+            Assert.AreEqual(key, cache.CreateKey(second, LayoutEngines.Dot));
+            _ = cache.CreateLayout(first, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            _ = cache.CreateLayout(second, LayoutEngines.Dot, CoordinateSystem.BottomLeft, compute);
+            Assert.AreEqual(1, computed);
+            Assert.AreEqual(1, cache.Hits);
+
+            // A corrupted file on disk is a miss
+            File.WriteAllBytes(Path.Combine(directory, key + ".xdotcache"), new byte[] { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff });
+            var other = new LayoutCache(maxMemoryBytes: 0, directory: directory);
+            Assert.IsFalse(other.TryGet(key, out _, out _));
+            Assert.AreEqual(1, other.Misses);
+        }
+        finally
+        {
+            Directory.Delete(directory, true);
+        }
+    }
+
+    [Test()]
+    public void TestCreateLayouts()
+    {
+        var inputs = Enumerable.Range(0, 3).Select(i =>
+        {
+            var root = RootGraph.CreateNew(GraphType.Directed, "batch" + i);
+            _ = root.GetOrAddEdge(root.GetOrAddNode("A"), root.GetOrAddNode("B" + i));
+            return root;
+        }).ToList();
+        // Dot does not produce any output for an unknown layout engine
+        inputs[1].SetAttribute("layout", "bogus");
+
+        var results = GraphvizCommand.CreateLayouts(inputs).ToList();
+        Assert.AreEqual(3, results.Count);
+        for (int i = 0; i < 3; i++)
+            Assert.AreSame(inputs[i], results[i].Input);
+
+        Assert.IsFalse(results[1].Succeeded);
+        Assert.IsNull(results[1].Layout);
+        Assert.IsInstanceOf<System.ApplicationException>(results[1].Error);
+
+        foreach (var result in new[] { results[0], results[2] })
+        {
+            Assert.IsTrue(result.Succeeded);
+            var node = result.Layout!.GetNode("A")!;
+            Assert.AreNotEqual(default(PointD), node.GetPosition());
+        }
+        Assert.IsNotNull(results[2].Layout!.GetNode("B2"));
+    }
+
+    [Test()]
+    public void TestLayoutSplitComponents()
+    {
+        RootGraph root = CreateUniqueTestGraph();
+        _ = root.GetOrAddEdge(root.GetOrAddNode("a"), root.GetOrAddNode("b"));
+        var d = root.GetOrAddNode("d");
+        _ = root.GetOrAddEdge(root.GetOrAddNode("c"), d);
+        _ = root.GetOrAddEdge(d, root.GetOrAddNode("e"));
+        _ = root.GetOrAddNode("f");
+        // The nodes of a cluster are kept together, even if they are not connected
+        var cluster = root.GetOrAddSubgraph("cluster_x");
+        cluster.SetAttribute("label", "x");
+        cluster.AddExisting(root.GetOrAddNode("g"));
+        cluster.AddExisting(root.GetOrAddNode("h"));
+
+        var options = new LayoutOptions { SplitComponents = true, MaxDegreeOfParallelism = 2 };
+        var xroot = root.CreateLayout(options);
+        Assert.IsTrue(GraphComparer.CheckTopologicallyEquals(root, xroot, Log));
+
+        var rootBox = xroot.GetBoundingBox();
+        var nodeBoxes = xroot.Nodes().Select(n => n.GetBoundingBox()).ToList();
+        foreach (var box in nodeBoxes)
+        {
+            Assert.GreaterOrEqual(box.X, rootBox.X - 1);
+            Assert.GreaterOrEqual(box.Y, rootBox.Y - 1);
+            Assert.LessOrEqual(box.FarPoint().X, rootBox.FarPoint().X + 1);
+            Assert.LessOrEqual(box.FarPoint().Y, rootBox.FarPoint().Y + 1);
+            Assert.AreEqual(1, nodeBoxes.Count(other => Overlap(box, other)));
+        }
+
+        var clusterBox = xroot.GetSubgraph("cluster_x")!.GetBoundingBox();
+        foreach (var name in new[] { "g", "h" })
+            Assert.IsTrue(Overlap(clusterBox, xroot.GetNode(name)!.GetBoundingBox()));
+        Assert.IsFalse(Overlap(clusterBox, xroot.GetNode("a")!.GetBoundingBox()));
+
+        // The drawing moves along with the node
+        var nodeA = xroot.GetNode("a")!;
+        var ellipse = nodeA.GetDrawing().OfType<XDotOp.UnfilledEllipse>().Single().Value;
+        Assert.AreEqual(nodeA.GetPosition().X, ellipse.X, 1);
+        Assert.AreEqual(nodeA.GetPosition().Y, ellipse.Y, 1);
+    }
+
+    private static bool Overlap(RectangleD a, RectangleD b)
+    {
+        return a.X < b.FarPoint().X && b.X < a.FarPoint().X && a.Y < b.FarPoint().Y && b.Y < a.FarPoint().Y;
+    }
+
+    [Test()]
+    public async Task TestCreateLayoutAsync()
+    {
+        CreateSimpleTestGraph(out RootGraph root, out _, out _);
+        var xroot = await root.CreateLayoutAsync(timeout: System.TimeSpan.FromMinutes(1));
+        Assert.AreEqual(2, xroot.Nodes().Count());
+        Assert.AreEqual(2, xroot.GetNode("A")!.GetRecordRectangles().Count());
+
+        var svg = await root.ToBytesAsync("svg");
+        Assert.IsTrue(GraphvizCommand.ConvertBytesOutputToString(svg).Contains("<svg"));
+
+        using var canceled = new CancellationTokenSource();
+        canceled.Cancel();
+        _ = Assert.ThrowsAsync<System.OperationCanceledException>(() => root.CreateLayoutAsync(cancellationToken: canceled.Token));
+    }
+
+    [Test()]
+    public void TestCreateLayoutAsyncTimeout()
+    {
+        var root = CreateRandomConnectedGraph(2000, 5);
+        var exception = Assert.ThrowsAsync<System.TimeoutException>(
+            () => GraphvizCommand.ExecAsync(root, timeout: System.TimeSpan.FromMilliseconds(1)));
+        Assert.IsTrue(exception!.Message.Contains("Error details so far"));
+    }
+
     [Test()]
     public void TestHtmlLabels()
     {
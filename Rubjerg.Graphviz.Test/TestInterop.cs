@@ -1,6 +1,9 @@
 using NUnit.Framework;
 using System.IO;
 using System;
+using System.Diagnostics;
+using System.Runtime.InteropServices;
+using System.Text;
 using static Rubjerg.Graphviz.FFI.GraphvizFFI;
 using static Rubjerg.Graphviz.FFI.TestLib;
 
@@ -81,4 +84,74 @@ public void TestOutputEncoding()
         // PDF doesn't seem to support unicode correctly?
         // Open issue: https://gitlab.com/graphviz/graphviz/-/issues/2508
     }
+
+    /// <summary>
+    /// The terminator is found at every offset from the alignment of the word at a time scan.
+    /// </summary>
+    [Test()]
+    public void TestMarshalFromUtf8Lengths()
+    {
+        var bytes = Encoding.UTF8.GetBytes(new string('x', 24) + "✅");
+        IntPtr ptr = Marshal.AllocHGlobal(bytes.Length + 9);
+        try
+        {
+            for (int offset = 0; offset < 8; offset++)
+            {
+                for (int length = 0; length <= bytes.Length; length++)
+                {
+                    Marshal.Copy(bytes, 0, ptr + offset, length);
+                    Marshal.WriteByte(ptr + offset + length, 0);
+                    Assert.AreEqual(Encoding.UTF8.GetString(bytes, 0, length), FFI.Marshaling.MarshalFromUtf8(ptr + offset, false));
+                }
+            }
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(ptr);
+        }
+    }
+
+    /// <summary>
+    /// Compares the marshaling of native strings with the byte by byte approach it replaced.
+    /// Prints the time per MB for both. This is a benchmark, so it only runs when selected explicitly.
+    /// </summary>
+    [TestCase(16)]
+    [Explicit]
+    [Category("Benchmark")]
+    public void TestMarshalingThroughput(int megabytes)
+    {
+        var text = new string('x', megabytes << 20) + "✅";
+        var bytes = Encoding.UTF8.GetBytes(text);
+        IntPtr ptr = Marshal.AllocHGlobal(bytes.Length + 1);
+        try
+        {
+            Marshal.Copy(bytes, 0, ptr, bytes.Length);
+            Marshal.WriteByte(ptr + bytes.Length, 0);
+
+            var watch = Stopwatch.StartNew();
+            int length = 0;
+            while (Marshal.ReadByte(ptr, length) != 0)
+                length++;
+            var copy = new byte[length];
+            Marshal.Copy(ptr, copy, 0, length);
+            var byteByByte = Encoding.UTF8.GetString(copy);
+            var byteByByteMs = watch.Elapsed.TotalMilliseconds;
+
+            watch.Restart();
+            var marshaled = FFI.Marshaling.MarshalFromUtf8(ptr, false);
+            var marshaledMs = watch.Elapsed.TotalMilliseconds;
+
+            TestContext.WriteLine($"Per MB: byte by byte {byteByByteMs / megabytes:F3} ms, in place {marshaledMs / megabytes:F3} ms");
+            Assert.AreEqual(text, byteByByte);
+            Assert.AreEqual(text, marshaled);
+        }
+        finally
+        {
+            Marshal.FreeHGlobal(ptr);
+        }
+
+        // Exercise every alignment of the terminator
+        for (int i = 0; i < 17; i++)
+            Assert.AreEqual(new string('y', i), EchoString(new string('y', i)));
+    }
 }
@@ -34,6 +34,27 @@ t 31
 
     }
 
+    [Test()]
+    public void TestXDotTranslateValues()
+    {
+        var testcase = @"
+B 4 70 10 70 15 75 15 75 10
+C 7 -#ff0000
+S 6 -dashed
+I 90 10 5 5 9 -image.png
+";
+        var result = XDotParser.ParseXDot(testcase, CoordinateSystem.TopLeft, 100);
+        Assert.AreEqual(4, result.Count);
+
+        var bezier = (XDotOp.UnfilledBezier)result[0];
+        Assert.AreEqual(new[] { new PointD(70, 90), new PointD(70, 85), new PointD(75, 85), new PointD(75, 90) }, bezier.Points);
+        Assert.AreEqual(new XDotOp.FillColor(new Color.Uniform("#ff0000")), result[1]);
+        Assert.AreEqual(new XDotOp.Style("dashed"), result[2]);
+        var image = (XDotOp.Image)result[3];
+        Assert.AreEqual("image.png", image.Value.Name);
+        Assert.AreEqual(RectangleD.Create(90, 85, 5, 5), image.Value.Position);
+    }
+
     [Test()]
     public void TestXDotRecordNode()
     {
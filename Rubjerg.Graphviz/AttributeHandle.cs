@@ -0,0 +1,54 @@
+using System;
+using static Rubjerg.Graphviz.FFI.GraphvizFFI;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// An attribute that has been looked up once for a given kind of object (graphs, nodes or edges) in a given root graph.
+/// Reading and writing through a handle skips marshaling the attribute name and looking it up by name,
+/// which pays off when the same attribute is accessed for many objects.
+/// A handle remains valid for as long as its root graph exists.
+/// </summary>
+public sealed class AttributeHandle
+{
+    internal readonly IntPtr _sym;
+    internal readonly int _kind;
+
+    public RootGraph MyRootGraph { get; }
+    public string Name { get; }
+
+    internal AttributeHandle(IntPtr sym, RootGraph root, int kind, string name)
+    {
+        _sym = sym;
+        _kind = kind;
+        MyRootGraph = root;
+        Name = name;
+    }
+
+    /// <summary>
+    /// Cgraph indexes the attribute values of an object by the symbol id, so using a symbol of
+    /// another kind or another root graph would access the wrong value, or memory out of bounds.
+    /// </summary>
+    internal void CheckBelongsTo(RootGraph root, int kind)
+    {
+        if (_kind != kind || MyRootGraph._ptr != root._ptr)
+            throw new ArgumentException($"Attribute handle {Name} does not belong to this kind of object in this root graph.");
+    }
+
+    /// <summary>
+    /// Look up the attribute, and introduce it with the given default if it was not introduced yet.
+    /// </summary>
+    internal static AttributeHandle GetOrIntroduce(RootGraph root, int kind, string name, string deflt)
+    {
+        _ = root ?? throw new ArgumentNullException(nameof(root));
+        _ = name ?? throw new ArgumentNullException(nameof(name));
+        _ = deflt ?? throw new ArgumentNullException(nameof(deflt));
+        IntPtr sym = AgattrLookup(root._ptr, kind, name);
+        if (sym == IntPtr.Zero)
+        {
+            Agattr(root._ptr, kind, name, deflt);
+            sym = AgattrLookup(root._ptr, kind, name);
+        }
+        return new AttributeHandle(sym, root, kind, name);
+    }
+}
@@ -97,6 +97,47 @@ public string SafeGetAttribute(string name, string deflt)
         return null;
     }
 
+    /// <summary>
+    /// The kind of attributes this object has: 0 for graphs, 1 for nodes and 2 for edges.
+    /// </summary>
+    internal abstract int AttributeKind { get; }
+
+    /// <summary>
+    /// Get a handle to the attribute with the given name for objects of this kind.
+    /// If the attribute was not introduced, return null.
+    /// </summary>
+    public AttributeHandle? GetAttributeHandle(string name)
+    {
+        IntPtr sym = Agattrsym(_ptr, name);
+        if (sym == IntPtr.Zero)
+            return null;
+        return new AttributeHandle(sym, MyRootGraph, AttributeKind, name);
+    }
+
+    /// <summary>
+    /// Get the attribute value for this object, or the default value of the attribute if no explicit value was set.
+    /// </summary>
+    public string? GetAttribute(AttributeHandle attribute)
+    {
+        CheckAttributeHandle(attribute);
+        return Agxget(_ptr, attribute._sym);
+    }
+
+    /// <summary>
+    /// Set the attribute value for this object.
+    /// </summary>
+    public void SetAttribute(AttributeHandle attribute, string? value)
+    {
+        CheckAttributeHandle(attribute);
+        _ = Agxset(_ptr, attribute._sym, value);
+    }
+
+    private void CheckAttributeHandle(AttributeHandle attribute)
+    {
+        _ = attribute ?? throw new ArgumentNullException(nameof(attribute));
+        attribute.CheckBelongsTo(MyRootGraph, AttributeKind);
+    }
+
     public void SetAttributeHtml(string name, string value)
     {
         AgsetHtml(_ptr, name, value);
@@ -44,6 +44,17 @@ public static void IntroduceAttributeHtml(RootGraph root, string name, string de
         AgattrHtml(root._ptr, 2, name, deflt);
     }
 
+    /// <summary>
+    /// Get a handle to the attribute for edges in the given graph, for fast repeated access.
+    /// If the attribute was not introduced yet, it is introduced with the given default.
+    /// </summary>
+    public static AttributeHandle GetAttributeHandle(RootGraph root, string name, string deflt = "")
+    {
+        return AttributeHandle.GetOrIntroduce(root, 2, name, deflt);
+    }
+
+    internal override int AttributeKind => 2;
+
     protected internal IntPtr HeadPtr()
     {
         return Aghead(_ptr);
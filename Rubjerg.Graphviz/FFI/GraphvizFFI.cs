@@ -1,4 +1,8 @@
 using System;
+using System.Collections.Concurrent;
+using System.IO;
+using System.Text;
+using System.Threading;
 using System.Runtime.InteropServices;
 
 namespace Rubjerg.Graphviz.FFI;
@@ -9,10 +13,113 @@ namespace Rubjerg.Graphviz.FFI;
 /// <summary>
 /// Graphviz is thread unsafe, so we wrap all function calls inside a lock to make sure we don't run into
 /// issues caused by multiple threads accessing the graphviz datastructures (like the GC executing a destructor).
+///
+/// By default all calls share a single global lock. In <see cref="LockingMode.PerRootGraph"/> mode,
+/// cgraph operations only lock the root graph they operate on, such that threads working on separate
+/// root graphs do not have to wait for each other. Operations that touch process wide state, like
+/// layouting, rendering, parsing and anonymous object creation, additionally take the global lock.
+/// Locks are always taken in the order: root graph locks (ordered by address), then the global lock.
 /// </summary>
 internal static class GraphvizFFI
 {
     private static readonly object _mutex = new object();
+    private static readonly ConcurrentDictionary<IntPtr, object> _rootLocks = new ConcurrentDictionary<IntPtr, object>();
+
+    // The locking mode, with FrozenFlag set once a root graph lock has been handed out
+    private static int _lockingState = (int)LockingMode.Global;
+    private const int FrozenFlag = 1 << 16;
+
+    /// <summary>
+    /// The mode can only be changed until the first root graph lock is handed out. Threads that are inside
+    /// graphviz calls would otherwise hold other locks than the threads that follow them. Setting the mode
+    /// that is already in effect is always allowed.
+    /// </summary>
+    /// <exception cref="InvalidOperationException">A lock has been handed out already</exception>
+    public static LockingMode LockingMode
+    {
+        get => (LockingMode)(Volatile.Read(ref _lockingState) & ~FrozenFlag);
+        set
+        {
+            int state = Volatile.Read(ref _lockingState);
+            while ((state & FrozenFlag) == 0)
+            {
+                int seen = Interlocked.CompareExchange(ref _lockingState, (int)value, state);
+                if (seen == state)
+                    return;
+                state = seen;
+            }
+            if ((LockingMode)(state & ~FrozenFlag) != value)
+                throw new InvalidOperationException("The locking mode cannot be changed after graphviz has been used.");
+        }
+    }
+
+    /// <summary>
+    /// Change the locking mode even though locks have been handed out. The caller must make sure that no
+    /// other thread uses graphviz, and that no graphs created in the other mode are finalized later.
+    /// This is meant for tests.
+    /// </summary>
+    internal static void ResetLockingMode(LockingMode mode)
+    {
+        Volatile.Write(ref _lockingState, (int)mode);
+    }
+
+    /// <summary>
+    /// The locking mode to hand out a lock in, which can no longer be changed afterwards.
+    /// </summary>
+    private static LockingMode FreezeLockingMode()
+    {
+        int state = Volatile.Read(ref _lockingState);
+        while ((state & FrozenFlag) == 0)
+        {
+            int seen = Interlocked.CompareExchange(ref _lockingState, state | FrozenFlag, state);
+            if (seen == state)
+                break;
+            state = seen;
+        }
+        return (LockingMode)(state & ~FrozenFlag);
+    }
+
+    /// <summary>
+    /// Agroot only reads fields that are fixed when the object is created, so it is safe to call without locking.
+    /// </summary>
+    private static IntPtr RootOf(IntPtr obj)
+    {
+        return IsWindows ? GraphvizLibWindows.agroot(obj) : GraphvizLibLinux.agroot(obj);
+    }
+
+    /// <summary>
+    /// The lock that protects the root graph that the given object belongs to.
+    /// </summary>
+    private static object LockFor(IntPtr obj)
+    {
+        if (FreezeLockingMode() == LockingMode.Global)
+            return _mutex;
+        return _rootLocks.GetOrAdd(RootOf(obj), _ => new object());
+    }
+
+    /// <summary>
+    /// The locks that protect the root graphs of the given objects, in the order in which they must be taken.
+    /// </summary>
+    private static (object first, object second) LockFor(IntPtr obj1, IntPtr obj2)
+    {
+        if (FreezeLockingMode() == LockingMode.Global)
+            return (_mutex, _mutex);
+        IntPtr root1 = RootOf(obj1);
+        IntPtr root2 = RootOf(obj2);
+        if (root1.ToInt64() > root2.ToInt64())
+            (root1, root2) = (root2, root1);
+        return (_rootLocks.GetOrAdd(root1, _ => new object()), _rootLocks.GetOrAdd(root2, _ => new object()));
+    }
+
+    /// <summary>
+    /// Cgraph hands out the ids of anonymous objects from a single process wide counter,
+    /// so creating them requires the global lock. Named objects get their id from the string
+    /// dictionary of their root graph, which is protected by the given root lock.
+    /// </summary>
+    private static object AnonymousIdLock(object rootLock, string? name, int create)
+    {
+        return name is null && create != 0 ? _mutex : rootLock;
+    }
 
     public static IntPtr GvContext()
     {
@@ -28,8 +135,27 @@ public static int GvFreeContext(IntPtr gvc)
             return IsWindows ? GraphvizLibWindows.gvFreeContext(gvc) : GraphvizLibLinux.gvFreeContext(gvc);
         }
     }
+    /// <summary>
+    /// Returns a new context with the given plugin libraries as builtins, or null if one of them cannot be loaded.
+    /// Such a context must be freed with <see cref="RjFreeContext"/>.
+    /// </summary>
+    public static IntPtr RjContextPlugins(byte[] names, int[] offsets, bool demandLoading)
+    {
+        lock (_mutex)
+        {
+            return GraphvizWrapperLib.rj_context_plugins(names, offsets, offsets.Length - 1, demandLoading ? 1 : 0);
+        }
+    }
+    public static int RjFreeContext(IntPtr gvc)
+    {
+        lock (_mutex)
+        {
+            return GraphvizWrapperLib.rj_free_context(gvc);
+        }
+    }
     public static int GvLayout(IntPtr gvc, IntPtr graph, string engine)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
             return MarshalToUtf8(engine, enginePtr => IsWindows ? GraphvizLibWindows.gvLayout(gvc, graph, enginePtr) : GraphvizLibLinux.gvLayout(gvc, graph, enginePtr));
@@ -37,6 +163,7 @@ public static int GvLayout(IntPtr gvc, IntPtr graph, string engine)
     }
     public static int GvFreeLayout(IntPtr gvc, IntPtr graph)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
             return IsWindows ? GraphvizLibWindows.gvFreeLayout(gvc, graph) : GraphvizLibLinux.gvFreeLayout(gvc, graph);
@@ -44,6 +171,7 @@ public static int GvFreeLayout(IntPtr gvc, IntPtr graph)
     }
     public static int GvRender(IntPtr gvc, IntPtr graph, string? format, IntPtr @out)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
             return MarshalToUtf8(format, formatPtr => IsWindows ? GraphvizLibWindows.gvRender(gvc, graph, formatPtr, @out) : GraphvizLibLinux.gvRender(gvc, graph, formatPtr, @out));
@@ -51,374 +179,734 @@ public static int GvRender(IntPtr gvc, IntPtr graph, string? format, IntPtr @out
     }
     public static int GvRenderFilename(IntPtr gvc, IntPtr graph, string? format, string? filename)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
             return MarshalToUtf8(format, formatPtr => MarshalToUtf8(filename, filenamePtr => IsWindows ? GraphvizLibWindows.gvRenderFilename(gvc, graph, formatPtr, filenamePtr) : GraphvizLibLinux.gvRenderFilename(gvc, graph, formatPtr, filenamePtr)));
         }
     }
-    public static IntPtr Agnode(IntPtr graph, string? name, int create)
+    /// <summary>
+    /// Render into a buffer allocated by graphviz, which is copied and released again with gvFreeRenderData.
+    /// </summary>
+    public static int GvRenderData(IntPtr gvc, IntPtr graph, string format, out byte[] result)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
-            return MarshalToUtf8(name, namePtr => IsWindows ? GraphvizLibWindows.agnode(graph, namePtr, create) : GraphvizLibLinux.agnode(graph, namePtr, create));
+            IntPtr data = IntPtr.Zero;
+            uint length = 0;
+            try
+            {
+                int rc = MarshalToUtf8(format, formatPtr => IsWindows
+                    ? GraphvizLibWindows.gvRenderData(gvc, graph, formatPtr, out data, out length)
+                    : GraphvizLibLinux.gvRenderData(gvc, graph, formatPtr, out data, out length));
+                result = new byte[rc == 0 ? length : 0];
+                if (result.Length > 0)
+                    Marshal.Copy(data, result, 0, result.Length);
+                return rc;
+            }
+            finally
+            {
+                // On failure graphviz may already have allocated the buffer
+                if (data != IntPtr.Zero)
+                {
+                    if (IsWindows)
+                        GraphvizLibWindows.gvFreeRenderData(data);
+                    else
+                        GraphvizLibLinux.gvFreeRenderData(data);
+                }
+            }
+        }
+    }
+    public static unsafe IntPtr Agnode(IntPtr graph, string? name, int create)
+    {
+        var buffer = EncodeArguments(name, out int nameOffset);
+        var rootLock = LockFor(graph);
+        lock (rootLock)
+        lock (AnonymousIdLock(rootLock, name, create))
+        fixed (byte* args = buffer)
+        {
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return IsWindows ? GraphvizLibWindows.agnode(graph, namePtr, create) : GraphvizLibLinux.agnode(graph, namePtr, create);
         }
     }
     public static int Agdegree(IntPtr graph, IntPtr node, int inset, int outset)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agdegree(graph, node, inset, outset) : GraphvizLibLinux.agdegree(graph, node, inset, outset);
         }
     }
     public static IntPtr Agfstout(IntPtr graph, IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agfstout(graph, node) : GraphvizLibLinux.agfstout(graph, node);
         }
     }
     public static IntPtr Agnxtout(IntPtr graph, IntPtr edge)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agnxtout(graph, edge) : GraphvizLibLinux.agnxtout(graph, edge);
         }
     }
     public static IntPtr Agfstin(IntPtr graph, IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agfstin(graph, node) : GraphvizLibLinux.agfstin(graph, node);
         }
     }
     public static IntPtr Agnxtin(IntPtr graph, IntPtr edge)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agnxtin(graph, edge) : GraphvizLibLinux.agnxtin(graph, edge);
         }
     }
     public static IntPtr Agfstedge(IntPtr graph, IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agfstedge(graph, node) : GraphvizLibLinux.agfstedge(graph, node);
         }
     }
     public static IntPtr Agnxtedge(IntPtr graph, IntPtr edge, IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agnxtedge(graph, edge, node) : GraphvizLibLinux.agnxtedge(graph, edge, node);
         }
     }
-    public static void Agattr(IntPtr graph, int type, string name, string deflt)
+    public static unsafe void Agattr(IntPtr graph, int type, string name, string deflt)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, deflt, out int nameOffset, out int defltOffset);
+        lock (LockFor(graph))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(deflt, defltPtr =>
-            MarshalToUtf8(name, namePtr =>
-            {
-                if (IsWindows)
-                    GraphvizLibWindows.agattr(graph, type, namePtr, defltPtr);
-                else
-                    GraphvizLibLinux.agattr(graph, type, namePtr, defltPtr);
-            }));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var defltPtr = ArgumentPointer(args, defltOffset);
+            _ = IsWindows ? GraphvizLibWindows.agattr(graph, type, namePtr, defltPtr) : GraphvizLibLinux.agattr(graph, type, namePtr, defltPtr);
         }
     }
-    public static void AgattrHtml(IntPtr graph, int type, string name, string deflt)
+    public static unsafe void AgattrHtml(IntPtr graph, int type, string name, string deflt)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, deflt, out int nameOffset, out int defltOffset);
+        lock (LockFor(graph))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(name, namePtr =>
-            MarshalToUtf8(deflt, defltPtr =>
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var defltPtr = ArgumentPointer(args, defltOffset);
+            if (IsWindows)
             {
-                if (IsWindows)
-                {
-                    var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(graph), defltPtr);
-                    GraphvizLibWindows.agattr(graph, type, namePtr, htmlPtr);
-                }
-                else
-                {
-                    var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(graph), defltPtr);
-                    GraphvizLibLinux.agattr(graph, type, namePtr, htmlPtr);
-                }
-            }));
+                var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(graph), defltPtr);
+                _ = GraphvizLibWindows.agattr(graph, type, namePtr, htmlPtr);
+            }
+            else
+            {
+                var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(graph), defltPtr);
+                _ = GraphvizLibLinux.agattr(graph, type, namePtr, htmlPtr);
+            }
         }
     }
 
-    public static void Agset(IntPtr obj, string name, string value)
+    public static unsafe void Agset(IntPtr obj, string name, string value)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, value, out int nameOffset, out int valueOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(name, namePtr =>
-            MarshalToUtf8(value, valuePtr =>
-            {
-                if (IsWindows)
-                    GraphvizLibWindows.agset(obj, namePtr, valuePtr);
-                else
-                    GraphvizLibLinux.agset(obj, namePtr, valuePtr);
-            }));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var valuePtr = ArgumentPointer(args, valueOffset);
+            if (IsWindows)
+                GraphvizLibWindows.agset(obj, namePtr, valuePtr);
+            else
+                GraphvizLibLinux.agset(obj, namePtr, valuePtr);
         }
     }
 
-    public static void AgsetHtml(IntPtr obj, string name, string value)
+    public static unsafe void AgsetHtml(IntPtr obj, string name, string value)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, value, out int nameOffset, out int valueOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(name, namePtr =>
-            MarshalToUtf8(value, valuePtr =>
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var valuePtr = ArgumentPointer(args, valueOffset);
+            if (IsWindows)
             {
-                if (IsWindows)
-                {
-                    var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(obj), valuePtr);
-                    GraphvizLibWindows.agset(obj, namePtr, htmlPtr);
-                }
-                else
-                {
-                    var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(obj), valuePtr);
-                    GraphvizLibLinux.agset(obj, namePtr, htmlPtr);
-                }
-            }));
+                var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(obj), valuePtr);
+                GraphvizLibWindows.agset(obj, namePtr, htmlPtr);
+            }
+            else
+            {
+                var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(obj), valuePtr);
+                GraphvizLibLinux.agset(obj, namePtr, htmlPtr);
+            }
         }
     }
 
-    public static void Agsafeset(IntPtr obj, string name, string? val, string? deflt)
+    public static unsafe void Agsafeset(IntPtr obj, string name, string? val, string? deflt)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, val, deflt, out int nameOffset, out int valOffset, out int defltOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(name, namePtr => MarshalToUtf8(val, valPtr => MarshalToUtf8(deflt, defltPtr =>
-            {
-                if (IsWindows)
-                    GraphvizLibWindows.agsafeset(obj, namePtr, valPtr, defltPtr);
-                else
-                    GraphvizLibLinux.agsafeset(obj, namePtr, valPtr, defltPtr);
-            })));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var valPtr = ArgumentPointer(args, valOffset);
+            var defltPtr = ArgumentPointer(args, defltOffset);
+            if (IsWindows)
+                GraphvizLibWindows.agsafeset(obj, namePtr, valPtr, defltPtr);
+            else
+                GraphvizLibLinux.agsafeset(obj, namePtr, valPtr, defltPtr);
         }
     }
-    public static void AgsafesetHtml(IntPtr obj, string name, string? val, string? deflt)
+    public static unsafe void AgsafesetHtml(IntPtr obj, string name, string? val, string? deflt)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, val, deflt, out int nameOffset, out int valOffset, out int defltOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
         {
-            MarshalToUtf8(name, namePtr => MarshalToUtf8(val, valPtr => MarshalToUtf8(deflt, defltPtr =>
+            var namePtr = ArgumentPointer(args, nameOffset);
+            var valPtr = ArgumentPointer(args, valOffset);
+            var defltPtr = ArgumentPointer(args, defltOffset);
+            if (IsWindows)
             {
-                if (IsWindows)
-                {
-                    var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(obj), defltPtr);
-                    GraphvizLibWindows.agsafeset(obj, namePtr, valPtr, htmlPtr);
-                }
-                else
-                {
-                    var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(obj), defltPtr);
-                    GraphvizLibLinux.agsafeset(obj, namePtr, valPtr, htmlPtr);
-                }
-            })));
+                var htmlPtr = GraphvizLibWindows.agstrdup_html(GraphvizLibWindows.agroot(obj), defltPtr);
+                GraphvizLibWindows.agsafeset(obj, namePtr, valPtr, htmlPtr);
+            }
+            else
+            {
+                var htmlPtr = GraphvizLibLinux.agstrdup_html(GraphvizLibLinux.agroot(obj), defltPtr);
+                GraphvizLibLinux.agsafeset(obj, namePtr, valPtr, htmlPtr);
+            }
         }
     }
     public static IntPtr Agroot(IntPtr obj)
     {
-        lock (_mutex)
+        lock (LockFor(obj))
         {
             return IsWindows ? GraphvizLibWindows.agroot(obj) : GraphvizLibLinux.agroot(obj);
         }
     }
     public static IntPtr Agnxtattr(IntPtr obj, int kind, IntPtr attribute)
     {
-        lock (_mutex)
+        lock (LockFor(obj))
         {
             return IsWindows ? GraphvizLibWindows.agnxtattr(obj, kind, attribute) : GraphvizLibLinux.agnxtattr(obj, kind, attribute);
         }
     }
     public static int Agcopyattr(IntPtr from, IntPtr to)
     {
-        lock (_mutex)
+        var (first, second) = LockFor(from, to);
+        lock (first)
+        lock (second)
         {
             return IsWindows ? GraphvizLibWindows.agcopyattr(from, to) : GraphvizLibLinux.agcopyattr(from, to);
         }
     }
     public static bool Ageqedge(IntPtr edge1, IntPtr edge2)
     {
-        lock (_mutex)
+        lock (LockFor(edge1))
         {
             return GraphvizWrapperLib.rj_ageqedge(edge1, edge2);
         }
     }
     public static IntPtr Agtail(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.rj_agtail(node);
         }
     }
     public static IntPtr Aghead(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.rj_aghead(node);
         }
     }
-    public static IntPtr Agedge(IntPtr graph, IntPtr tail, IntPtr head, string? name, int create)
+    public static unsafe IntPtr Agedge(IntPtr graph, IntPtr tail, IntPtr head, string? name, int create)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, out int nameOffset);
+        var rootLock = LockFor(graph);
+        lock (rootLock)
+        lock (AnonymousIdLock(rootLock, name, create))
+        fixed (byte* args = buffer)
         {
-            return MarshalToUtf8(name, namePtr => IsWindows ? GraphvizLibWindows.agedge(graph, tail, head, namePtr, create) : GraphvizLibLinux.agedge(graph, tail, head, namePtr, create));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return IsWindows ? GraphvizLibWindows.agedge(graph, tail, head, namePtr, create) : GraphvizLibLinux.agedge(graph, tail, head, namePtr, create);
         }
     }
     public static IntPtr Agmkin(IntPtr edge)
     {
-        lock (_mutex)
+        lock (LockFor(edge))
         {
             return GraphvizWrapperLib.rj_agmkin(edge);
         }
     }
     public static IntPtr Agmkout(IntPtr edge)
     {
-        lock (_mutex)
+        lock (LockFor(edge))
         {
             return GraphvizWrapperLib.rj_agmkout(edge);
         }
     }
     public static IntPtr Agparent(IntPtr obj)
     {
-        lock (_mutex)
+        lock (LockFor(obj))
         {
             return IsWindows ? GraphvizLibWindows.agparent(obj) : GraphvizLibLinux.agparent(obj);
         }
     }
     public static int Agclose(IntPtr graph)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
-            return IsWindows ? GraphvizLibWindows.agclose(graph) : GraphvizLibLinux.agclose(graph);
+            // Forget the lock of a root graph while we still hold the global lock,
+            // such that a new root graph allocated at the same address gets a fresh lock.
+            bool isRoot = RootOf(graph) == graph;
+            int result = IsWindows ? GraphvizLibWindows.agclose(graph) : GraphvizLibLinux.agclose(graph);
+            if (isRoot)
+                _ = _rootLocks.TryRemove(graph, out _);
+            return result;
         }
     }
     public static int Agdelete(IntPtr graph, IntPtr item)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agdelete(graph, item) : GraphvizLibLinux.agdelete(graph, item);
         }
     }
     public static IntPtr Agfstnode(IntPtr graph)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agfstnode(graph) : GraphvizLibLinux.agfstnode(graph);
         }
     }
     public static IntPtr Agnxtnode(IntPtr graph, IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agnxtnode(graph, node) : GraphvizLibLinux.agnxtnode(graph, node);
         }
     }
     public static int Agcontains(IntPtr graph, IntPtr obj)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agcontains(graph, obj) : GraphvizLibLinux.agcontains(graph, obj);
         }
     }
-    public static IntPtr Agsubg(IntPtr graph, string? name, int create)
+    public static unsafe IntPtr Agsubg(IntPtr graph, string? name, int create)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, out int nameOffset);
+        var rootLock = LockFor(graph);
+        lock (rootLock)
+        lock (AnonymousIdLock(rootLock, name, create))
+        fixed (byte* args = buffer)
         {
-            return MarshalToUtf8(name, namePtr => IsWindows ? GraphvizLibWindows.agsubg(graph, namePtr, create) : GraphvizLibLinux.agsubg(graph, namePtr, create));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return IsWindows ? GraphvizLibWindows.agsubg(graph, namePtr, create) : GraphvizLibLinux.agsubg(graph, namePtr, create);
         }
     }
     public static IntPtr Agfstsubg(IntPtr graph)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agfstsubg(graph) : GraphvizLibLinux.agfstsubg(graph);
         }
     }
     public static IntPtr Agnxtsubg(IntPtr graph)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agnxtsubg(graph) : GraphvizLibLinux.agnxtsubg(graph);
         }
     }
     public static int Agisstrict(IntPtr ptr)
     {
-        lock (_mutex)
+        lock (LockFor(ptr))
         {
             return IsWindows ? GraphvizLibWindows.agisstrict(ptr) : GraphvizLibLinux.agisstrict(ptr);
         }
     }
     public static int Agisdirected(IntPtr ptr)
     {
-        lock (_mutex)
+        lock (LockFor(ptr))
         {
             return IsWindows ? GraphvizLibWindows.agisdirected(ptr) : GraphvizLibLinux.agisdirected(ptr);
         }
     }
     public static int Agisundirected(IntPtr ptr)
     {
-        lock (_mutex)
+        lock (LockFor(ptr))
         {
             return IsWindows ? GraphvizLibWindows.agisundirected(ptr) : GraphvizLibLinux.agisundirected(ptr);
         }
     }
     public static IntPtr Agsubedge(IntPtr graph, IntPtr edge, int create)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agsubedge(graph, edge, create) : GraphvizLibLinux.agsubedge(graph, edge, create);
         }
     }
     public static IntPtr Agsubnode(IntPtr graph, IntPtr node, int create)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             return IsWindows ? GraphvizLibWindows.agsubnode(graph, node, create) : GraphvizLibLinux.agsubnode(graph, node, create);
         }
     }
     public static IntPtr EdgeLabel(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.edge_label(node);
         }
     }
     public static string? Rjagmemwrite(IntPtr graph)
     {
+        lock (LockFor(graph))
         lock (_mutex)
         {
-            var strPtr = GraphvizWrapperLib.rj_agmemwrite(graph);
-            return MarshalFromUtf8(strPtr, true);
+            var strPtr = GraphvizWrapperLib.rj_agwrite_buffer(graph, out var length);
+            if (strPtr == IntPtr.Zero)
+                return null;
+            return MarshalFromUtf8(strPtr, checked((int)length.ToUInt64()), true);
         }
     }
-    public static IntPtr GraphLabel(IntPtr node)
+    /// <summary>
+    /// Write the graph in dot format to the given stream. Returns whether graphviz succeeded.
+    /// The graph is written into a list of native chunks of at most 64 KB while the locks are held, and the chunks
+    /// are only copied to the stream after the locks are released, such that a slow stream does not hold up other
+    /// graphviz calls. Every chunk is staged in the same managed buffer and freed as soon as it is written.
+    /// </summary>
+    public static bool Rjagwrite(IntPtr graph, Stream stream)
     {
+        IntPtr chunk;
+        lock (LockFor(graph))
         lock (_mutex)
+        {
+            chunk = GraphvizWrapperLib.rj_agwrite_chunks(graph);
+        }
+        if (chunk == IntPtr.Zero)
+            return false;
+        try
+        {
+            byte[] buffer = new byte[1 << 16];
+            for (; chunk != IntPtr.Zero; chunk = GraphvizWrapperLib.rj_free_chunk(chunk))
+            {
+                var data = GraphvizWrapperLib.rj_chunk_data(chunk, out var length);
+                int count = checked((int)length.ToUInt64());
+                if (count == 0)
+                    continue;
+                Marshal.Copy(data, buffer, 0, count);
+                stream.Write(buffer, 0, count);
+            }
+        }
+        finally
+        {
+            while (chunk != IntPtr.Zero)
+                chunk = GraphvizWrapperLib.rj_free_chunk(chunk);
+        }
+        return true;
+    }
+    /// <summary>
+    /// Copy native memory to the stream in chunks, without copying all of it into a managed array first.
+    /// </summary>
+    private static unsafe void CopyToStream(IntPtr data, long length, Stream stream)
+    {
+        using var source = new UnmanagedMemoryStream((byte*)data, length);
+        source.CopyTo(stream, 1 << 16);
+    }
+    public static IntPtr GraphLabel(IntPtr node)
+    {
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.graph_label(node);
         }
     }
-    public static string? Agget(IntPtr obj, string name)
+    public static unsafe string? Agget(IntPtr obj, string name)
     {
-        lock (_mutex)
+        var buffer = EncodeArguments(name, out int nameOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
         {
-            return MarshalToUtf8(name, namePtr => MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agget(obj, namePtr) : GraphvizLibLinux.agget(obj, namePtr), false));
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agget(obj, namePtr) : GraphvizLibLinux.agget(obj, namePtr), false);
+        }
+    }
+    /// <summary>
+    /// Look up the attribute symbol with the given name and kind, without introducing it.
+    /// </summary>
+    public static unsafe IntPtr AgattrLookup(IntPtr graph, int type, string name)
+    {
+        var buffer = EncodeArguments(name, out int nameOffset);
+        lock (LockFor(graph))
+        fixed (byte* args = buffer)
+        {
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return IsWindows ? GraphvizLibWindows.agattr(graph, type, namePtr, IntPtr.Zero) : GraphvizLibLinux.agattr(graph, type, namePtr, IntPtr.Zero);
+        }
+    }
+    public static unsafe IntPtr Agattrsym(IntPtr obj, string name)
+    {
+        var buffer = EncodeArguments(name, out int nameOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
+        {
+            var namePtr = ArgumentPointer(args, nameOffset);
+            return IsWindows ? GraphvizLibWindows.agattrsym(obj, namePtr) : GraphvizLibLinux.agattrsym(obj, namePtr);
+        }
+    }
+    public static string? Agxget(IntPtr obj, IntPtr sym)
+    {
+        lock (LockFor(obj))
+        {
+            return MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agxget(obj, sym) : GraphvizLibLinux.agxget(obj, sym), false);
+        }
+    }
+    public static unsafe int Agxset(IntPtr obj, IntPtr sym, string? value)
+    {
+        var buffer = EncodeArguments(value, out int valueOffset);
+        lock (LockFor(obj))
+        fixed (byte* args = buffer)
+        {
+            var valuePtr = ArgumentPointer(args, valueOffset);
+            return IsWindows ? GraphvizLibWindows.agxset(obj, sym, valuePtr) : GraphvizLibLinux.agxset(obj, sym, valuePtr);
+        }
+    }
+    public static string[] GetAttributeColumn(IntPtr graph, IntPtr sym, bool edges)
+    {
+        lock (LockFor(graph))
+        {
+            return MarshalColumnFromUtf8(edges ? GraphvizWrapperLib.get_edge_attribute_column(graph, sym) : GraphvizWrapperLib.get_node_attribute_column(graph, sym));
+        }
+    }
+    public static int SetAttributeColumn(IntPtr graph, IntPtr sym, bool edges, byte[] data, int[] offsets)
+    {
+        lock (LockFor(graph))
+        {
+            int count = offsets.Length - 1;
+            return edges ? GraphvizWrapperLib.set_edge_attribute_column(graph, sym, data, offsets, count) : GraphvizWrapperLib.set_node_attribute_column(graph, sym, data, offsets, count);
         }
     }
     public static string? Rjagnameof(IntPtr obj)
     {
-        lock (_mutex)
+        lock (LockFor(obj))
         {
-            return MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agnameof(obj) : GraphvizLibLinux.agnameof(obj), false);
+            // The names of anonymous objects are printed into a static buffer, which needs the global lock
+            if (!GraphvizWrapperLib.rj_agisanonymous(obj))
+                return MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agnameof(obj) : GraphvizLibLinux.agnameof(obj), false);
+            lock (_mutex)
+            {
+                return MarshalFromUtf8(IsWindows ? GraphvizLibWindows.agnameof(obj) : GraphvizLibLinux.agnameof(obj), false);
+            }
         }
     }
     public static void CloneAttributeDeclarations(IntPtr graphfrom, IntPtr graphto)
     {
-        lock (_mutex)
+        var (first, second) = LockFor(graphfrom, graphto);
+        lock (first)
+        lock (second)
         {
             GraphvizWrapperLib.clone_attribute_declarations(graphfrom, graphto);
         }
     }
+    public static void RjCloneInto(IntPtr graph, IntPtr target)
+    {
+        // Cloning anonymous objects draws from the global id counter of graphviz
+        var (first, second) = LockFor(graph, target);
+        lock (first)
+        lock (second)
+        lock (_mutex)
+        {
+            GraphvizWrapperLib.rj_clone_into(graph, target);
+        }
+    }
+    public static IntPtr RjCloneGraph(IntPtr graph, string? name)
+    {
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            return MarshalToUtf8(name, namePtr => GraphvizWrapperLib.rj_clone_graph(graph, namePtr));
+        }
+    }
+    /// <summary>
+    /// Create a new root graph in a single call, see rj_build_graph in the wrapper for the layout of the strings.
+    /// </summary>
+    public static IntPtr RjBuildGraph(string? name, int graphtype, byte[] strings, int[] offsets, int nodeCount,
+        int edgeNameCount, int[] tails, int[] heads, int[] edgeNames, int[] attributeKinds)
+    {
+        // The graph is new, so only the global lock for the ids of anonymous edges is needed
+        lock (_mutex)
+        {
+            return MarshalToUtf8(name, namePtr => GraphvizWrapperLib.rj_build_graph(namePtr, graphtype, strings, offsets,
+                nodeCount, edgeNameCount, tails, heads, edgeNames, tails.Length, attributeKinds, attributeKinds.Length));
+        }
+    }
+    /// <summary>
+    /// Write the binary snapshot of the graph to the stream, see rj_write_snapshot in the wrapper for the format.
+    /// Like <see cref="Rjagwrite"/>, the snapshot is only copied to the stream after the locks are released.
+    /// </summary>
+    public static void RjWriteSnapshot(IntPtr graph, Stream stream)
+    {
+        IntPtr data;
+        int length;
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            data = GraphvizWrapperLib.rj_write_snapshot(graph, out length);
+        }
+        if (data == IntPtr.Zero)
+            throw new OutOfMemoryException("Graphviz could not allocate the snapshot.");
+        try
+        {
+            CopyToStream(data, length, stream);
+        }
+        finally
+        {
+            free_str(data);
+        }
+    }
+    /// <returns>A new root graph, or null if the given part of the data is not a valid snapshot</returns>
+    public static unsafe IntPtr RjReadSnapshot(ArraySegment<byte> data)
+    {
+        // The graph is new, so only the global lock for the ids of anonymous objects is needed
+        lock (_mutex)
+        fixed (byte* array = data.Array)
+        {
+            return GraphvizWrapperLib.rj_read_snapshot((IntPtr)(array + data.Offset), data.Count);
+        }
+    }
+    /// <summary>
+    /// Returns eight values per difference, see graph_diff in the wrapper.
+    /// </summary>
+    public static string[] RjCompareGraphs(IntPtr a, IntPtr b, bool compareAttributes)
+    {
+        var (first, second) = LockFor(a, b);
+        lock (first)
+        lock (second)
+        lock (_mutex)
+        {
+            return MarshalColumnFromUtf8(GraphvizWrapperLib.rj_compare_graphs(a, b, compareAttributes ? 1 : 0));
+        }
+    }
+    public static IntPtr RjFindDescendant(IntPtr graph, string name)
+    {
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            return MarshalToUtf8(name, namePtr => GraphvizWrapperLib.rj_find_descendant(graph, namePtr));
+        }
+    }
+    public static IntPtr RjAddSubgraphFromNodes(IntPtr graph, string name, IntPtr[] nodes)
+    {
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            return MarshalToUtf8(name, namePtr => GraphvizWrapperLib.rj_add_subgraph_from_nodes(graph, namePtr, nodes, nodes.Length));
+        }
+    }
+    /// <returns>The number of subgraphs that were deleted, not counting their descendants</returns>
+    public static int RjDeleteSubgraphs(IntPtr graph, IntPtr[] subgraphs)
+    {
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            return GraphvizWrapperLib.rj_delete_subgraphs(graph, subgraphs, subgraphs.Length);
+        }
+    }
+    /// <summary>
+    /// The nodes reachable from the source, and the depth of each of them, see rj_traverse.
+    /// </summary>
+    public static (IntPtr[] nodes, int[] depths) RjTraverse(IntPtr graph, IntPtr source, int order, int direction)
+    {
+        lock (LockFor(graph))
+        {
+            IntPtr array = GraphvizWrapperLib.rj_traverse(graph, source, order, direction, out IntPtr depthArray, out int count);
+            if (array == IntPtr.Zero)
+                throw new OutOfMemoryException("Graphviz could not allocate the traversal.");
+            try
+            {
+                var nodes = new IntPtr[count];
+                var depths = new int[count];
+                Marshal.Copy(array, nodes, 0, count);
+                Marshal.Copy(depthArray, depths, 0, count);
+                return (nodes, depths);
+            }
+            finally
+            {
+                free_str(array);
+                free_str(depthArray);
+            }
+        }
+    }
+    /// <returns>The nodes in topological order, or null if the graph contains a cycle</returns>
+    public static IntPtr[]? RjTopologicalSort(IntPtr graph)
+    {
+        lock (LockFor(graph))
+        {
+            IntPtr array = GraphvizWrapperLib.rj_topological_sort(graph, out int count);
+            if (count < 0)
+                return null;
+            if (array == IntPtr.Zero)
+                throw new OutOfMemoryException("Graphviz could not allocate the topological order.");
+            try
+            {
+                var nodes = new IntPtr[count];
+                Marshal.Copy(array, nodes, 0, count);
+                return nodes;
+            }
+            finally
+            {
+                free_str(array);
+            }
+        }
+    }
+    public static ulong[] RjGraphFingerprint(IntPtr graph, byte[] attributes, int[] offsets)
+    {
+        var result = new ulong[2];
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            GraphvizWrapperLib.rj_graph_fingerprint(graph, attributes, offsets, offsets.Length - 1, result);
+        }
+        return result;
+    }
+    /// <summary>
+    /// Returns a new root graph for each connected component. The caller owns the graphs.
+    /// </summary>
+    public static IntPtr[] RjSplitComponents(IntPtr graph)
+    {
+        lock (LockFor(graph))
+        lock (_mutex)
+        {
+            IntPtr array = GraphvizWrapperLib.rj_split_components(graph, out int count);
+            if (array == IntPtr.Zero)
+                throw new InvalidOperationException("Graphviz could not create the graphs of the components.");
+            var result = new IntPtr[count];
+            Marshal.Copy(array, result, 0, count);
+            free_str(array);
+            return result;
+        }
+    }
+    public static void RjMergeLayout(IntPtr target, IntPtr layout, double dx, double dy)
+    {
+        var (first, second) = LockFor(target, layout);
+        lock (first)
+        lock (second)
+        lock (_mutex)
+        {
+            GraphvizWrapperLib.rj_merge_layout(target, layout, dx, dy);
+        }
+    }
     public static string? ImsymKey(IntPtr sym)
     {
         lock (_mutex)
@@ -477,51 +965,61 @@ public static double LabelFontsize(IntPtr label)
     }
     public static double NodeX(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.node_x(node);
         }
     }
     public static double NodeY(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.node_y(node);
         }
     }
     public static double NodeWidth(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.node_width(node);
         }
     }
     public static double NodeHeight(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.node_height(node);
         }
     }
     public static IntPtr NodeLabel(IntPtr node)
     {
-        lock (_mutex)
+        lock (LockFor(node))
         {
             return GraphvizWrapperLib.node_label(node);
         }
     }
     public static void ConvertToUndirected(IntPtr graph)
     {
-        lock (_mutex)
+        lock (LockFor(graph))
         {
             GraphvizWrapperLib.convert_to_undirected(graph);
         }
     }
     public static IntPtr Rjagmemread(string input)
+    {
+        // The byte array is pinned during the call, so the native side reads the utf8 bytes in place.
+        // Windows line endings are normalized by the native read discipline.
+        var bytes = Encoding.UTF8.GetBytes(input);
+        lock (_mutex)
+        {
+            return GraphvizWrapperLib.rj_agmemread_buffer(bytes, (UIntPtr)bytes.Length);
+        }
+    }
+    public static IntPtr Rjagreadfile(string path)
     {
         lock (_mutex)
         {
-            return MarshalToUtf8(input, GraphvizWrapperLib.rj_agmemread);
+            return MarshalToUtf8(path, GraphvizWrapperLib.rj_agread_file);
         }
     }
     public static IntPtr Rjagopen(string? name, int graphtype)
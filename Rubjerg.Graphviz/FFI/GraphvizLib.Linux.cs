@@ -8,7 +8,9 @@ namespace Rubjerg.Graphviz.FFI;
 internal static class GraphvizLibLinux
 {
     [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern void agattr(IntPtr graph, int type, IntPtr name, IntPtr deflt);
+    internal static extern IntPtr agattr(IntPtr graph, int type, IntPtr name, IntPtr deflt);
+    [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern IntPtr agattrsym(IntPtr obj, IntPtr name);
 
     [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
     internal static extern IntPtr agedge(IntPtr graph, IntPtr tail, IntPtr head, IntPtr name, int create);
@@ -77,6 +79,10 @@ internal static class GraphvizLibLinux
     internal static extern IntPtr agsubg(IntPtr graph, IntPtr name, int create);
     [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
     internal static extern IntPtr agsubnode(IntPtr graph, IntPtr node, int create);
+    [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern IntPtr agxget(IntPtr obj, IntPtr sym);
+    [DllImport(CGraphLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern int agxset(IntPtr obj, IntPtr sym, IntPtr value);
 
     [DllImport(GvcLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
     internal static extern IntPtr gvContext();
@@ -90,4 +96,8 @@ internal static class GraphvizLibLinux
     internal static extern int gvRender(IntPtr gvc, IntPtr graph, IntPtr format, IntPtr @out);
     [DllImport(GvcLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
     internal static extern int gvRenderFilename(IntPtr gvc, IntPtr graph, IntPtr format, IntPtr filename);
+    [DllImport(GvcLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern int gvRenderData(IntPtr gvc, IntPtr graph, IntPtr format, out IntPtr result, out uint length);
+    [DllImport(GvcLibNameLinux, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+    internal static extern void gvFreeRenderData(IntPtr data);
 }
\ No newline at end of file
@@ -3,7 +3,6 @@
 
 namespace Rubjerg.Graphviz.FFI;
 
-using static Marshaling;
 using static Constants;
 
 internal static class GraphvizWrapperLib
@@ -15,241 +14,118 @@ internal static class GraphvizWrapperLib
     internal static extern void convert_to_undirected(IntPtr graph);
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr edge_label(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr graph_label(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr label_fontname(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double label_fontsize(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double label_height(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr label_text(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double label_width(IntPtr label);
-
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double label_x(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double label_y(IntPtr label);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double node_height(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr node_label(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double node_width(IntPtr node);
-
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double node_x(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern double node_y(IntPtr node);
-
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    [return: MarshalAs(UnmanagedType.U1)]
-    internal static extern bool rj_ageqedge(IntPtr edge1, IntPtr edge2);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_aghead(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agmemread(IntPtr input);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agmemwrite(IntPtr graph);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agmkin(IntPtr edge);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agmkout(IntPtr edge);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agtail(IntPtr node);
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_sym_key(IntPtr sym);
-
+    internal static extern void rj_clone_into(IntPtr graph, IntPtr target);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    internal static extern IntPtr rj_agopen(IntPtr name, int graphtype);
-
-    // Accessors for xdot
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern UIntPtr get_cnt(IntPtr xdot);
-
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_ops(IntPtr xdot);
-
-    // Accessors for xdot_image
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_name_image(IntPtr img);
-    public static string? GetNameImage(IntPtr img) => MarshalFromUtf8(get_name_image(img), false);
-
+    internal static extern IntPtr rj_clone_graph(IntPtr graph, IntPtr name);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_pos(IntPtr img);
-
-    // Accessors for xdot_font
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_size(IntPtr font);
-
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_name_font(IntPtr font);
-    public static string? GetNameFont(IntPtr img) => MarshalFromUtf8(get_name_font(img), false);
-
-    // Accessors for xdot_op
-    [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern XDotKind get_kind(IntPtr op);
-
+    internal static extern IntPtr rj_build_graph(IntPtr name, int graphtype, byte[] strings, int[] offsets, int nodeCount,
+        int edgeNameCount, int[] tails, int[] heads, int[] edgeNames, int edgeCount, int[] attributeKinds, int attributeCount);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_ellipse(IntPtr op);
-
+    internal static extern IntPtr rj_write_snapshot(IntPtr graph, out int length);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_polygon(IntPtr op);
-
+    internal static extern IntPtr rj_read_snapshot(IntPtr data, int length);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_polyline(IntPtr op);
-
+    internal static extern IntPtr rj_compare_graphs(IntPtr a, IntPtr b, int compareAttributes);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_bezier(IntPtr op);
-
+    internal static extern IntPtr rj_split_components(IntPtr graph, out int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_text(IntPtr op);
-
+    internal static extern void rj_merge_layout(IntPtr target, IntPtr layout, double dx, double dy);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_image(IntPtr op);
-
+    internal static extern IntPtr rj_find_descendant(IntPtr graph, IntPtr name);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_color(IntPtr op);
-    public static string? GetColor(IntPtr op) => MarshalFromUtf8(get_color(op), false);
-
+    internal static extern IntPtr rj_add_subgraph_from_nodes(IntPtr graph, IntPtr name, IntPtr[] nodes, int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_grad_color(IntPtr op);
-
+    internal static extern int rj_delete_subgraphs(IntPtr graph, IntPtr[] subgraphs, int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_font(IntPtr op);
-
+    internal static extern IntPtr rj_traverse(IntPtr graph, IntPtr source, int order, int direction, out IntPtr depths, out int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_style(IntPtr op);
-    public static string? GetStyle(IntPtr op) => MarshalFromUtf8(get_style(op), false);
-
+    internal static extern IntPtr rj_topological_sort(IntPtr graph, out int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern uint get_fontchar(IntPtr op);
-
-    // Accessors for xdot_color
+    internal static extern void rj_graph_fingerprint(IntPtr graph, byte[] attributes, int[] offsets, int count, [Out] ulong[] result);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern XDotGradType get_type(IntPtr clr);
-
+    internal static extern IntPtr rj_context_plugins(byte[] names, int[] offsets, int count, int demandLoading);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_clr(IntPtr clr);
-    public static string? GetClr(IntPtr clr) => MarshalFromUtf8(get_clr(clr), false);
+    internal static extern int rj_free_context(IntPtr gvc);
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_ling(IntPtr clr);
-
+    internal static extern IntPtr edge_label(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_ring(IntPtr clr);
-
-    // Accessors for xdot_text
+    internal static extern IntPtr graph_label(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x_text(IntPtr txt);
-
+    internal static extern IntPtr label_fontname(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y_text(IntPtr txt);
-
+    internal static extern double label_fontsize(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern TextAlign get_align(IntPtr txt);
-
+    internal static extern double label_height(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_width(IntPtr txt);
-
+    internal static extern IntPtr label_text(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_text_str(IntPtr txt);
-    public static string? GetTextStr(IntPtr txt) => MarshalFromUtf8(get_text_str(txt), false);
+    internal static extern double label_width(IntPtr label);
 
-    // Accessors for xdot_linear_grad
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x0_ling(IntPtr ling);
-
+    internal static extern double label_x(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y0_ling(IntPtr ling);
-
+    internal static extern double label_y(IntPtr label);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x1_ling(IntPtr ling);
-
+    internal static extern double node_height(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y1_ling(IntPtr ling);
-
+    internal static extern IntPtr node_label(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern int get_n_stops_ling(IntPtr ling);
+    internal static extern double node_width(IntPtr node);
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_stops_ling(IntPtr ling);
-
-    // Accessors for xdot_radial_grad
+    internal static extern double node_x(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x0_ring(IntPtr ring);
+    internal static extern double node_y(IntPtr node);
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y0_ring(IntPtr ring);
-
+    [return: MarshalAs(UnmanagedType.U1)]
+    internal static extern bool rj_ageqedge(IntPtr edge1, IntPtr edge2);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_r0_ring(IntPtr ring);
-
+    [return: MarshalAs(UnmanagedType.U1)]
+    internal static extern bool rj_agisanonymous(IntPtr obj);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x1_ring(IntPtr ring);
-
+    internal static extern IntPtr rj_aghead(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y1_ring(IntPtr ring);
-
+    internal static extern IntPtr rj_agmemread(IntPtr input);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_r1_ring(IntPtr ring);
-
+    internal static extern IntPtr rj_agmemread_buffer(byte[] data, UIntPtr length);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern int get_n_stops_ring(IntPtr ring);
-
+    internal static extern IntPtr rj_agread_file(IntPtr path);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_stops_ring(IntPtr ring);
-
-    // Accessors for xdot_color_stop
+    internal static extern IntPtr rj_agmemwrite(IntPtr graph);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern float get_frac(IntPtr stop);
-
+    internal static extern IntPtr rj_agwrite_buffer(IntPtr graph, out UIntPtr length);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern IntPtr get_color_stop(IntPtr stop);
-    public static string? GetColorStop(IntPtr stop) => MarshalFromUtf8(get_color_stop(stop), false);
-
-    // Accessors for xdot_polyline
+    internal static extern IntPtr rj_agwrite_chunks(IntPtr graph);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern UIntPtr get_cnt_polyline(IntPtr polyline);
-
+    internal static extern IntPtr rj_chunk_data(IntPtr chunk, out UIntPtr length);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_pts_polyline(IntPtr polyline);
-
-    // Accessors for xdot_point
+    internal static extern IntPtr rj_free_chunk(IntPtr chunk);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x_point(IntPtr point);
-
+    internal static extern IntPtr rj_agmkin(IntPtr edge);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y_point(IntPtr point);
-
+    internal static extern IntPtr rj_agmkout(IntPtr edge);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_z_point(IntPtr point);
-
-    // Accessors for xdot_rect
+    internal static extern IntPtr rj_agtail(IntPtr node);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_x_rect(IntPtr rect);
+    internal static extern IntPtr rj_sym_key(IntPtr sym);
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_y_rect(IntPtr rect);
+    internal static extern IntPtr rj_agopen(IntPtr name, int graphtype);
 
+    // Bulk attribute access, see Marshaling.MarshalColumnFromUtf8 for the layout of the result
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_w_rect(IntPtr rect);
-
+    internal static extern IntPtr get_node_attribute_column(IntPtr graph, IntPtr sym);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern double get_h_rect(IntPtr rect);
-
-    // Index function for xdot_color_stop array
+    internal static extern IntPtr get_edge_attribute_column(IntPtr graph, IntPtr sym);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_color_stop_at_index(IntPtr stops, int index);
-
-    // Index function for xdot_op array
+    internal static extern int set_node_attribute_column(IntPtr graph, IntPtr sym, byte[] data, int[] offsets, int count);
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_op_at_index(IntPtr ops, int index);
+    internal static extern int set_edge_attribute_column(IntPtr graph, IntPtr sym, byte[] data, int[] offsets, int count);
 
-    // Index function for xdot_pt array
+    // Flatten the complete xdot into a single buffer, see XDot.cpp for the layout.
+    // Ownership of the buffer is transferred to the caller.
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    public static extern IntPtr get_pt_at_index(IntPtr pts, int index);
+    public static extern IntPtr pack_xdot(IntPtr xdot);
 }
\ No newline at end of file
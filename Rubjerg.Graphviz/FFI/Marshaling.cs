@@ -17,10 +17,58 @@ internal static class Marshaling
     /// <returns>.NET unicode string</returns>
     public static string? MarshalFromUtf8(IntPtr ptr, bool free)
     {
-        var bytes = CopyCharPtrToByteArray(ptr, free);
-        if (bytes is null)
+        if (ptr == IntPtr.Zero)
             return null;
-        return Encoding.UTF8.GetString(bytes);
+        return MarshalFromUtf8(ptr, Utf8Length(ptr), free);
+    }
+
+    /// <summary>
+    /// Marshal a utf8 string of known length to a .NET string, decoding it in place.
+    /// </summary>
+    /// <param name="ptr">Pointer to the native string, must not be null</param>
+    /// <param name="length">The number of bytes, excluding any null terminator</param>
+    /// <param name="free">Whether to free the native string after marshaling</param>
+    public static unsafe string MarshalFromUtf8(IntPtr ptr, int length, bool free)
+    {
+        try
+        {
+            return length == 0 ? "" : Encoding.UTF8.GetString((byte*)ptr, length);
+        }
+        finally
+        {
+            if (free)
+                free_str(ptr);
+        }
+    }
+
+    /// <summary>
+    /// Find the length of a null terminated native string. After aligning the pointer, this checks
+    /// 8 bytes at a time for a zero byte. Aligned reads never cross a page boundary, so they
+    /// cannot touch memory beyond the page that contains the terminator.
+    /// </summary>
+    public static unsafe int Utf8Length(IntPtr ptr)
+    {
+        const ulong ones = 0x0101010101010101;
+        const ulong highs = 0x8080808080808080;
+        byte* start = (byte*)ptr;
+        byte* current = start;
+        while (((ulong)current & 7) != 0)
+        {
+            if (*current == 0)
+                return checked((int)(current - start));
+            current++;
+        }
+        // (word - ones) & ~word & highs is nonzero iff word contains a zero byte
+        while (true)
+        {
+            ulong word = *(ulong*)current;
+            if (((word - ones) & ~word & highs) != 0)
+                break;
+            current += 8;
+        }
+        while (*current != 0)
+            current++;
+        return checked((int)(current - start));
     }
 
     public static void MarshalToUtf8(string? s, Action<IntPtr> continuation, bool free = true)
@@ -35,7 +83,7 @@ public static void MarshalToUtf8(string? s, Action<IntPtr> continuation, bool fr
     /// <param name="free">Whether to free the allocated native c-string after the action returned</param>
     /// <param name="continuation">the continuation consuming the native c-string</param>
     /// <returns></returns>
-    public static T MarshalToUtf8<T>(string? s, Func<IntPtr, T> continuation, bool free = true)
+    public static unsafe T MarshalToUtf8<T>(string? s, Func<IntPtr, T> continuation, bool free = true)
     {
         IntPtr ptr = IntPtr.Zero;
         if (s is null)
@@ -44,17 +92,18 @@ public static T MarshalToUtf8<T>(string? s, Func<IntPtr, T> continuation, bool f
         }
         else
         {
-            var bytes = Encoding.UTF8.GetBytes(s);
             try
             {
                 // allocate native c-string with an extra byte for the null terminator
-                ptr = Marshal.AllocHGlobal(bytes.Length + 1);
+                int maxLength = Encoding.UTF8.GetMaxByteCount(s.Length);
+                ptr = Marshal.AllocHGlobal(maxLength + 1);
 
-                // copy the UTF8 bytes to the allocated memory
-                Marshal.Copy(bytes, 0, ptr, bytes.Length);
-
-                // set the null terminator
-                Marshal.WriteByte(ptr + bytes.Length, 0);
+                // encode the string directly into the allocated memory, and set the null terminator
+                fixed (char* chars = s)
+                {
+                    int length = Encoding.UTF8.GetBytes(chars, s.Length, (byte*)ptr, maxLength);
+                    ((byte*)ptr)[length] = 0;
+                }
 
                 // call the continuation function with the native pointer
                 return continuation(ptr);
@@ -69,17 +118,129 @@ public static T MarshalToUtf8<T>(string? s, Func<IntPtr, T> continuation, bool f
         }
     }
 
-    public static byte[]? CopyCharPtrToByteArray(IntPtr ptr, bool free)
+    /// <summary>
+    /// Arguments that do not fit are encoded into a one-off buffer,
+    /// such that a single huge string does not stay around for the lifetime of the thread.
+    /// </summary>
+    private const int MaxScratchSize = 1 << 16;
+
+    [ThreadStatic]
+    private static byte[]? _scratch;
+
+    /// <summary>
+    /// Encode string arguments for a native call as null terminated utf8 strings, one after the other,
+    /// in a per thread scratch buffer that is reused between calls. This avoids allocating on every call.
+    /// Pin the returned buffer and use <see cref="ArgumentPointer"/> to get a pointer to each string.
+    /// The buffer contents are valid until the next call on the same thread.
+    /// </summary>
+    public static byte[] EncodeArguments(string? s1, out int offset1)
     {
-        if (ptr == IntPtr.Zero) return null;
+        return EncodeArguments(s1, null, null, out offset1, out _, out _);
+    }
 
-        // Find the length of the string by looking for the null terminator
-        int len = 0;
-        while (Marshal.ReadByte(ptr, len) != 0)
+    /// <inheritdoc cref="EncodeArguments(string?, out int)"/>
+    public static byte[] EncodeArguments(string? s1, string? s2, out int offset1, out int offset2)
+    {
+        return EncodeArguments(s1, s2, null, out offset1, out offset2, out _);
+    }
+
+    /// <inheritdoc cref="EncodeArguments(string?, out int)"/>
+    public static byte[] EncodeArguments(string? s1, string? s2, string? s3, out int offset1, out int offset2, out int offset3)
+    {
+        int required = MaxEncodedSize(s1) + MaxEncodedSize(s2) + MaxEncodedSize(s3);
+        byte[]? buffer = _scratch;
+        if (buffer is null || buffer.Length < required)
         {
-            len++;
+            int size = 256;
+            while (size < required)
+                size *= 2;
+            buffer = new byte[size];
+            if (size <= MaxScratchSize)
+                _scratch = buffer;
         }
 
+        int position = 0;
+        offset1 = AppendArgument(buffer, ref position, s1);
+        offset2 = AppendArgument(buffer, ref position, s2);
+        offset3 = AppendArgument(buffer, ref position, s3);
+        return buffer;
+    }
+
+    /// <summary>
+    /// The pointer to an argument encoded by EncodeArguments, or null for a null string.
+    /// </summary>
+    public static unsafe IntPtr ArgumentPointer(byte* buffer, int offset)
+    {
+        return offset < 0 ? IntPtr.Zero : (IntPtr)(buffer + offset);
+    }
+
+    private static int MaxEncodedSize(string? s)
+    {
+        return s is null ? 0 : Encoding.UTF8.GetMaxByteCount(s.Length) + 1;
+    }
+
+    private static int AppendArgument(byte[] buffer, ref int position, string? s)
+    {
+        if (s is null)
+            return -1;
+        int offset = position;
+        position += Encoding.UTF8.GetBytes(s, 0, s.Length, buffer, position);
+        buffer[position++] = 0;
+        return offset;
+    }
+
+    /// <summary>
+    /// Marshal a native column of utf8 strings to .NET strings, and free the native column.
+    /// The column starts with the int32 number of values, followed by count + 1 int32 offsets into the
+    /// utf8 data that follows. Value i consists of the bytes [offsets[i], offsets[i + 1]) of the data.
+    /// </summary>
+    public static string[] MarshalColumnFromUtf8(IntPtr ptr)
+    {
+        if (ptr == IntPtr.Zero)
+            throw new OutOfMemoryException("Graphviz could not allocate the column.");
+        try
+        {
+            int count = Marshal.ReadInt32(ptr);
+            var offsets = new int[count + 1];
+            Marshal.Copy(ptr + sizeof(int), offsets, 0, count + 1);
+            var data = new byte[offsets[count]];
+            Marshal.Copy(ptr + sizeof(int) * (count + 2), data, 0, data.Length);
+
+            var result = new string[count];
+            for (int i = 0; i < count; i++)
+                result[i] = Encoding.UTF8.GetString(data, offsets[i], offsets[i + 1] - offsets[i]);
+            return result;
+        }
+        finally
+        {
+            free_str(ptr);
+        }
+    }
+
+    /// <summary>
+    /// Marshal .NET strings to a single utf8 buffer without null terminators, together with count + 1
+    /// offsets into that buffer, such that value i consists of the bytes [offsets[i], offsets[i + 1]).
+    /// </summary>
+    public static (byte[] data, int[] offsets) MarshalColumnToUtf8(IReadOnlyList<string> values)
+    {
+        var offsets = new int[values.Count + 1];
+        for (int i = 0; i < values.Count; i++)
+        {
+            _ = values[i] ?? throw new ArgumentException("Attribute values must not be null.", nameof(values));
+            offsets[i + 1] = offsets[i] + Encoding.UTF8.GetByteCount(values[i]);
+        }
+
+        var data = new byte[offsets[values.Count]];
+        for (int i = 0; i < values.Count; i++)
+            _ = Encoding.UTF8.GetBytes(values[i], 0, values[i].Length, data, offsets[i]);
+        return (data, offsets);
+    }
+
+    public static byte[]? CopyCharPtrToByteArray(IntPtr ptr, bool free)
+    {
+        if (ptr == IntPtr.Zero) return null;
+
+        int len = Utf8Length(ptr);
         byte[] byteArray = new byte[len];
         Marshal.Copy(ptr, byteArray, 0, len);
         if (free)
@@ -90,5 +251,5 @@ public static T MarshalToUtf8<T>(string? s, Func<IntPtr, T> continuation, bool f
     }
 
     [DllImport(GraphvizWrapperLibName, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
-    private static extern void free_str(IntPtr ptr);
+    internal static extern void free_str(IntPtr ptr);
 }
@@ -1,6 +1,8 @@
 ﻿using System;
 using System.Collections.Generic;
 using System.Linq;
+using System.Runtime.InteropServices;
+using System.Text;
 
 namespace Rubjerg.Graphviz.FFI;
 
@@ -53,80 +55,92 @@ internal static List<XDotOp> TranslateXDot(IntPtr xdotPtr, CoordinateSystem coor
         if (xdotPtr == IntPtr.Zero)
             throw new ArgumentNullException(nameof(xdotPtr));
 
+        // Marshal the whole xdot in one go, instead of calling into native code for every field
+        IntPtr packedPtr = GraphvizWrapperLib.pack_xdot(xdotPtr);
+        if (packedPtr == IntPtr.Zero)
+            throw new InvalidOperationException("Could not pack xdot");
+        PackedXDot packed;
+        try
+        {
+            packed = new PackedXDot(packedPtr);
+        }
+        finally
+        {
+            Marshaling.free_str(packedPtr);
+        }
+
         XDot xdot = new XDot
         {
-            Count = (int)GraphvizWrapperLib.get_cnt(xdotPtr)
+            Count = packed.OpCount
         };
 
         // Translate the array of XDotOps
         int count = xdot.Count;
         xdot.Ops = new XDotOp[count];
-        var opsPtr = GraphvizWrapperLib.get_ops(xdotPtr);
 
         var activeFont = Font.Default;
         var activeFontChar = FontChar.None;
         for (int i = 0; i < count; ++i)
         {
-            IntPtr xdotOpPtr = GraphvizWrapperLib.get_op_at_index(opsPtr, i);
-            var kind = GraphvizWrapperLib.get_kind(xdotOpPtr);
+            var kind = (XDotKind)packed.ReadInt();
             switch (kind)
             {
                 case XDotKind.FilledEllipse:
-                    xdot.Ops[i] = new XDotOp.FilledEllipse(TranslateEllipse(GraphvizWrapperLib.get_ellipse(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.FilledEllipse(packed.ReadRect()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.UnfilledEllipse:
-                    xdot.Ops[i] = new XDotOp.UnfilledEllipse(TranslateEllipse(GraphvizWrapperLib.get_ellipse(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.UnfilledEllipse(packed.ReadRect()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.FilledPolygon:
-                    xdot.Ops[i] = new XDotOp.FilledPolygon(TranslatePolyline(GraphvizWrapperLib.get_polyline(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.FilledPolygon(packed.ReadPolyline()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.UnfilledPolygon:
-                    xdot.Ops[i] = new XDotOp.FilledPolygon(TranslatePolyline(GraphvizWrapperLib.get_polyline(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.FilledPolygon(packed.ReadPolyline()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.FilledBezier:
-                    xdot.Ops[i] = new XDotOp.FilledBezier(TranslatePolyline(GraphvizWrapperLib.get_polyline(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.FilledBezier(packed.ReadPolyline()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.UnfilledBezier:
-                    xdot.Ops[i] = new XDotOp.UnfilledBezier(TranslatePolyline(GraphvizWrapperLib.get_polyline(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.UnfilledBezier(packed.ReadPolyline()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.Polyline:
-                    xdot.Ops[i] = new XDotOp.PolyLine(TranslatePolyline(GraphvizWrapperLib.get_polyline(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.PolyLine(packed.ReadPolyline()
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.Text:
-                    xdot.Ops[i] = new XDotOp.Text(TranslateText(GraphvizWrapperLib.get_text(xdotOpPtr), activeFont, activeFontChar)
+                    xdot.Ops[i] = new XDotOp.Text(TranslateText(packed, activeFont, activeFontChar)
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.FillColor:
-                    xdot.Ops[i] = new XDotOp.FillColor(new Color.Uniform(GraphvizWrapperLib.GetColor(xdotOpPtr)!));
+                    xdot.Ops[i] = new XDotOp.FillColor(new Color.Uniform(packed.ReadString()!));
                     break;
                 case XDotKind.PenColor:
-                    xdot.Ops[i] = new XDotOp.PenColor(new Color.Uniform(GraphvizWrapperLib.GetColor(xdotOpPtr)!));
+                    xdot.Ops[i] = new XDotOp.PenColor(new Color.Uniform(packed.ReadString()!));
                     break;
                 case XDotKind.GradFillColor:
-                    xdot.Ops[i] = new XDotOp.FillColor(TranslateGradColor(GraphvizWrapperLib.get_grad_color(xdotOpPtr)));
+                    xdot.Ops[i] = new XDotOp.FillColor(TranslateGradColor(packed));
                     break;
                 case XDotKind.GradPenColor:
-                    xdot.Ops[i] = new XDotOp.PenColor(TranslateGradColor(GraphvizWrapperLib.get_grad_color(xdotOpPtr)));
+                    xdot.Ops[i] = new XDotOp.PenColor(TranslateGradColor(packed));
                     break;
                 case XDotKind.Font:
-                    activeFont = TranslateFont(GraphvizWrapperLib.get_font(xdotOpPtr));
+                    activeFont = TranslateFont(packed);
                     break;
                 case XDotKind.Style:
-                    xdot.Ops[i] = new XDotOp.Style(GraphvizWrapperLib.GetStyle(xdotOpPtr)!);
+                    xdot.Ops[i] = new XDotOp.Style(packed.ReadString()!);
                     break;
                 case XDotKind.Image:
-                    xdot.Ops[i] = new XDotOp.Image(TranslateImage(GraphvizWrapperLib.get_image(xdotOpPtr))
+                    xdot.Ops[i] = new XDotOp.Image(TranslateImage(packed)
                         .ForCoordSystem(coordinateSystem, maxY));
                     break;
                 case XDotKind.FontChar:
-                    activeFontChar = TranslateFontChar(GraphvizWrapperLib.get_fontchar(xdotOpPtr));
+                    activeFontChar = TranslateFontChar((uint)packed.ReadInt());
                     break;
                 default:
                     throw new ArgumentException($"Unexpected XDotOp.Kind: {kind}");
@@ -141,165 +155,182 @@ private static FontChar TranslateFontChar(uint value)
         return (FontChar)(int)value;
     }
 
-    private static ImageInfo TranslateImage(IntPtr imagePtr)
+    private static ImageInfo TranslateImage(PackedXDot packed)
     {
         ImageInfo image = new ImageInfo
         (
-            Position: TranslateRect(GraphvizWrapperLib.get_pos(imagePtr)),
-            Name: GraphvizWrapperLib.GetNameImage(imagePtr)
+            Position: packed.ReadRect(),
+            Name: packed.ReadString()
         );
 
         return image;
     }
 
-    private static Font TranslateFont(IntPtr fontPtr)
+    private static Font TranslateFont(PackedXDot packed)
     {
         Font font = new Font
         (
-            Size: GraphvizWrapperLib.get_size(fontPtr),
-            Name: GraphvizWrapperLib.GetNameFont(fontPtr)!
+            Size: packed.ReadDouble(),
+            Name: packed.ReadString()!
         );
 
         return font;
     }
 
-    private static RectangleD TranslateEllipse(IntPtr ellipsePtr)
+    private static Color TranslateGradColor(PackedXDot packed)
     {
-        RectangleD ellipse = RectangleD.Create
-        (
-            GraphvizWrapperLib.get_x_rect(ellipsePtr),
-            GraphvizWrapperLib.get_y_rect(ellipsePtr),
-            GraphvizWrapperLib.get_w_rect(ellipsePtr),
-            GraphvizWrapperLib.get_h_rect(ellipsePtr)
-        );
-
-        return ellipse;
-    }
-
-    private static Color TranslateGradColor(IntPtr colorPtr)
-    {
-        var type = GraphvizWrapperLib.get_type(colorPtr);
+        var type = (XDotGradType)packed.ReadInt();
         switch (type)
         {
             case XDotGradType.None:
-                return new Color.Uniform(GraphvizWrapperLib.GetClr(colorPtr)!);
+                return new Color.Uniform(packed.ReadString()!);
             case XDotGradType.Linear:
-                return new Color.Linear(TranslateLinearGrad(GraphvizWrapperLib.get_ling(colorPtr)));
+                return new Color.Linear(TranslateLinearGrad(packed));
             case XDotGradType.Radial:
-                return new Color.Radial(TranslateRadialGrad(GraphvizWrapperLib.get_ring(colorPtr)));
+                return new Color.Radial(TranslateRadialGrad(packed));
             default:
                 throw new ArgumentException($"Unexpected XDotColor.Type: {type}");
         }
     }
 
-    private static LinearGradient TranslateLinearGrad(IntPtr lingPtr)
+    private static LinearGradient TranslateLinearGrad(PackedXDot packed)
     {
-        int count = GraphvizWrapperLib.get_n_stops_ling(lingPtr);
-        LinearGradient linearGrad = new LinearGradient
+        var point0 = packed.ReadPoint();
+        var point1 = packed.ReadPoint();
+        return new LinearGradient
         (
-            Point0: new PointD(GraphvizWrapperLib.get_x0_ling(lingPtr), GraphvizWrapperLib.get_y0_ling(lingPtr)),
-            Point1: new PointD(GraphvizWrapperLib.get_x1_ling(lingPtr), GraphvizWrapperLib.get_y1_ling(lingPtr)),
-            Stops: new ColorStop[count]
+            Point0: point0,
+            Point1: point1,
+            Stops: TranslateColorStops(packed)
         );
-
-        // Translate the array of ColorStops
-        var stopsPtr = GraphvizWrapperLib.get_stops_ling(lingPtr);
-        for (int i = 0; i < count; ++i)
-        {
-            IntPtr colorStopPtr = GraphvizWrapperLib.get_color_stop_at_index(stopsPtr, i);
-            linearGrad.Stops[i] = TranslateColorStop(colorStopPtr);
-        }
-
-        return linearGrad;
     }
 
-    private static RadialGradient TranslateRadialGrad(IntPtr ringPtr)
+    private static RadialGradient TranslateRadialGrad(PackedXDot packed)
     {
-        int count = GraphvizWrapperLib.get_n_stops_ring(ringPtr);
-        RadialGradient radialGrad = new RadialGradient
+        var point0 = packed.ReadPoint();
+        var radius0 = packed.ReadDouble();
+        var point1 = packed.ReadPoint();
+        var radius1 = packed.ReadDouble();
+        return new RadialGradient
         (
-            Point0: new PointD(GraphvizWrapperLib.get_x0_ring(ringPtr), GraphvizWrapperLib.get_y0_ring(ringPtr)),
-            Point1: new PointD(GraphvizWrapperLib.get_x1_ring(ringPtr), GraphvizWrapperLib.get_y1_ring(ringPtr)),
-            Radius0: GraphvizWrapperLib.get_r0_ring(ringPtr),
-            Radius1: GraphvizWrapperLib.get_r1_ring(ringPtr),
-            Stops: new ColorStop[count]
+            Point0: point0,
+            Point1: point1,
+            Radius0: radius0,
+            Radius1: radius1,
+            Stops: TranslateColorStops(packed)
         );
+    }
 
-        // Translate the array of ColorStops
-        var stopsPtr = GraphvizWrapperLib.get_stops_ring(ringPtr);
+    private static ColorStop[] TranslateColorStops(PackedXDot packed)
+    {
+        int count = packed.ReadInt();
+        var stops = new ColorStop[count];
         for (int i = 0; i < count; ++i)
         {
-            IntPtr colorStopPtr = GraphvizWrapperLib.get_color_stop_at_index(stopsPtr, i);
-            radialGrad.Stops[i] = TranslateColorStop(colorStopPtr);
+            stops[i] = new ColorStop
+            (
+                Frac: (float)packed.ReadDouble(),
+                HtmlColor: packed.ReadString()!
+            );
         }
-
-        return radialGrad;
+        return stops;
     }
 
-    private static ColorStop TranslateColorStop(IntPtr stopPtr)
+    private static TextInfo TranslateText(PackedXDot packed, Font activeFont, FontChar activeFontChar)
     {
-        ColorStop colorStop = new ColorStop
+        var anchor = packed.ReadPoint();
+        var width = packed.ReadDouble();
+        var align = (TextAlign)packed.ReadInt();
+        TextInfo text = new TextInfo
         (
-            Frac: GraphvizWrapperLib.get_frac(stopPtr),
-            HtmlColor: GraphvizWrapperLib.GetColorStop(stopPtr)!
+            anchor,
+            align,
+            width,
+            packed.ReadString()!,
+            activeFont,
+            activeFontChar,
+            CoordinateSystem.BottomLeft
         );
 
-        return colorStop;
+        return text;
     }
 
-    private static PointD[] TranslatePolyline(IntPtr polylinePtr)
+    /// <summary>
+    /// Reader for the buffer produced by pack_xdot, see XDot.cpp for the layout.
+    /// The ints and doubles sections are consumed in order, as the ops are translated.
+    /// </summary>
+    private sealed class PackedXDot
     {
-        int count = (int)GraphvizWrapperLib.get_cnt_polyline(polylinePtr);
-        var points = new PointD[count];
+        private const int Version = 1;
+        private const int HeaderInts = 5;
 
-        // Translate the array of Points
-        var pointsPtr = GraphvizWrapperLib.get_pts_polyline(polylinePtr);
-        for (int i = 0; i < count; ++i)
+        private readonly int[] _ints;
+        private readonly double[] _doubles;
+        private readonly byte[] _strings;
+        private int _intPos;
+        private int _doublePos;
+
+        public int OpCount { get; }
+
+        /// <summary>
+        /// Copy the sections of the buffer. Does not take ownership of the buffer.
+        /// </summary>
+        public PackedXDot(IntPtr buffer)
         {
-            IntPtr pointPtr = GraphvizWrapperLib.get_pt_at_index(pointsPtr, i);
-            points[i] = TranslatePoint(pointPtr);
+            var header = new int[HeaderInts];
+            Marshal.Copy(buffer, header, 0, HeaderInts);
+            if (header[0] != Version)
+                throw new InvalidOperationException($"Unsupported packed xdot version {header[0]}, expected {Version}");
+
+            OpCount = header[1];
+            _ints = new int[header[2]];
+            _doubles = new double[header[3]];
+            _strings = new byte[header[4]];
+
+            IntPtr cursor = buffer + HeaderInts * sizeof(int);
+            Marshal.Copy(cursor, _ints, 0, _ints.Length);
+            cursor += _ints.Length * sizeof(int);
+            Marshal.Copy(cursor, _doubles, 0, _doubles.Length);
+            cursor += _doubles.Length * sizeof(double);
+            Marshal.Copy(cursor, _strings, 0, _strings.Length);
         }
 
-        return points;
-    }
+        public int ReadInt() => _ints[_intPos++];
 
-    private static PointD TranslatePoint(IntPtr pointPtr)
-    {
-        var point = new PointD
-        (
-            X: GraphvizWrapperLib.get_x_point(pointPtr),
-            Y: GraphvizWrapperLib.get_y_point(pointPtr)
-        );
-
-        return point;
-    }
+        public double ReadDouble() => _doubles[_doublePos++];
 
-    private static RectangleD TranslateRect(IntPtr rectPtr)
-    {
-        var rect = RectangleD.Create
-        (
-            x: GraphvizWrapperLib.get_x_rect(rectPtr),
-            y: GraphvizWrapperLib.get_y_rect(rectPtr),
-            width: GraphvizWrapperLib.get_w_rect(rectPtr),
-            height: GraphvizWrapperLib.get_h_rect(rectPtr)
-        );
+        public PointD ReadPoint()
+        {
+            var x = ReadDouble();
+            var y = ReadDouble();
+            return new PointD(x, y);
+        }
 
-        return rect;
-    }
+        public RectangleD ReadRect()
+        {
+            var x = ReadDouble();
+            var y = ReadDouble();
+            var w = ReadDouble();
+            var h = ReadDouble();
+            return RectangleD.Create(x, y, w, h);
+        }
 
-    private static TextInfo TranslateText(IntPtr txtPtr, Font activeFont, FontChar activeFontChar)
-    {
-        TextInfo text = new TextInfo
-        (
-            new PointD(GraphvizWrapperLib.get_x_text(txtPtr), GraphvizWrapperLib.get_y_text(txtPtr)),
-            GraphvizWrapperLib.get_align(txtPtr),
-            GraphvizWrapperLib.get_width(txtPtr),
-            GraphvizWrapperLib.GetTextStr(txtPtr)!,
-            activeFont,
-            activeFontChar,
-            CoordinateSystem.BottomLeft
-        );
+        public PointD[] ReadPolyline()
+        {
+            int count = ReadInt();
+            var points = new PointD[count];
+            for (int i = 0; i < count; ++i)
+                points[i] = ReadPoint();
+            return points;
+        }
 
-        return text;
+        public string? ReadString()
+        {
+            int offset = ReadInt();
+            if (offset < 0)
+                return null;
+            int end = Array.IndexOf(_strings, (byte)0, offset);
+            return Encoding.UTF8.GetString(_strings, offset, end - offset);
+        }
     }
 }
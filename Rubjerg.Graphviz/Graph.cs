@@ -3,10 +3,22 @@
 using System.Diagnostics;
 using System.IO;
 using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
 using static Rubjerg.Graphviz.FFI.GraphvizFFI;
 
 namespace Rubjerg.Graphviz;
 
+/// <summary>
+/// The edges that a traversal follows from a node. Edges of undirected graphs are always followed in both directions.
+/// </summary>
+public enum TraversalDirection
+{
+    Out = 0,
+    In = 1,
+    Both = 2
+}
+
 /// <summary>
 /// Wraps a cgraph graph object - either a subgraph or a rootgraph.
 /// </summary>
@@ -46,6 +58,17 @@ public static void IntroduceAttributeHtml(RootGraph root, string name, string de
         AgattrHtml(root._ptr, 0, name, deflt);
     }
 
+    /// <summary>
+    /// Get a handle to the attribute for subgraphs in the given graph, for fast repeated access.
+    /// If the attribute was not introduced yet, it is introduced with the given default.
+    /// </summary>
+    public static AttributeHandle GetAttributeHandle(RootGraph root, string name, string deflt = "")
+    {
+        return AttributeHandle.GetOrIntroduce(root, 0, name, deflt);
+    }
+
+    internal override int AttributeKind => 0;
+
     public bool Contains(CGraphThing thing)
     {
         return Agcontains(_ptr, thing._ptr) != 0;
@@ -76,6 +99,148 @@ public IEnumerable<Edge> Edges()
         return Nodes().SelectMany(n => n.EdgesOut());
     }
 
+    /// <summary>
+    /// The nodes of this graph that are reachable from the source via edges of this graph, in breadth first order,
+    /// starting with the source. The traversal runs in graphviz, in a single call.
+    /// </summary>
+    public Node[] BreadthFirst(Node source, TraversalDirection direction = TraversalDirection.Out)
+    {
+        return Traverse(source, 0, direction).nodes;
+    }
+
+    /// <summary>
+    /// The nodes of this graph that are reachable from the source via edges of this graph, in depth first pre order
+    /// or post order. The traversal runs in graphviz, in a single call.
+    /// </summary>
+    public Node[] DepthFirst(Node source, bool postOrder = false, TraversalDirection direction = TraversalDirection.Out)
+    {
+        return Traverse(source, postOrder ? 2 : 1, direction).nodes;
+    }
+
+    /// <summary>
+    /// The number of edges on a shortest path from the source to each node of this graph that is reachable from it.
+    /// </summary>
+    public Dictionary<Node, int> Distances(Node source, TraversalDirection direction = TraversalDirection.Out)
+    {
+        var (nodes, depths) = Traverse(source, 0, direction);
+        var result = new Dictionary<Node, int>(nodes.Length);
+        for (int i = 0; i < nodes.Length; i++)
+            result[nodes[i]] = depths[i];
+        return result;
+    }
+
+    /// <summary>
+    /// All nodes of this graph, ordered such that every edge of this graph points from an earlier node to a later node.
+    /// </summary>
+    /// <exception cref="InvalidOperationException">When the graph is undirected or contains a cycle</exception>
+    public Node[] TopologicalSort()
+    {
+        if (!IsDirected())
+            throw new InvalidOperationException("Only directed graphs can be sorted topologically.");
+        var nodes = RjTopologicalSort(_ptr)
+            ?? throw new InvalidOperationException("The graph contains a cycle, so it cannot be sorted topologically.");
+        return nodes.Select(ptr => new Node(ptr, MyRootGraph)).ToArray();
+    }
+
+    private (Node[] nodes, int[] depths) Traverse(Node source, int order, TraversalDirection direction)
+    {
+        _ = source ?? throw new ArgumentNullException(nameof(source));
+        if (!Contains(source))
+            throw new ArgumentException("The source node is not part of this graph.", nameof(source));
+        var (nodes, depths) = RjTraverse(_ptr, source._ptr, order, (int)direction);
+        return (nodes.Select(ptr => new Node(ptr, MyRootGraph)).ToArray(), depths);
+    }
+
+    /// <summary>
+    /// Get the value of the given node attribute for all nodes, in the order of <see cref="Nodes"/>.
+    /// This retrieves all values in a single call into graphviz.
+    /// </summary>
+    public string[] GetNodeAttributeColumn(AttributeHandle attribute)
+    {
+        return GetAttributeColumn(attribute, 1);
+    }
+
+    /// <summary>
+    /// Get the value of the given edge attribute for all edges, in the order of <see cref="Edges"/>.
+    /// This retrieves all values in a single call into graphviz.
+    /// </summary>
+    public string[] GetEdgeAttributeColumn(AttributeHandle attribute)
+    {
+        return GetAttributeColumn(attribute, 2);
+    }
+
+    /// <summary>
+    /// Set the value of the given node attribute for all nodes, in the order of <see cref="Nodes"/>.
+    /// The number of values must equal the number of nodes.
+    /// </summary>
+    public void SetNodeAttributeColumn(AttributeHandle attribute, IReadOnlyList<string> values)
+    {
+        SetAttributeColumn(attribute, 1, values);
+    }
+
+    /// <summary>
+    /// Set the value of the given edge attribute for all edges, in the order of <see cref="Edges"/>.
+    /// The number of values must equal the number of edges.
+    /// </summary>
+    public void SetEdgeAttributeColumn(AttributeHandle attribute, IReadOnlyList<string> values)
+    {
+        SetAttributeColumn(attribute, 2, values);
+    }
+
+    private string[] GetAttributeColumn(AttributeHandle attribute, int kind)
+    {
+        _ = attribute ?? throw new ArgumentNullException(nameof(attribute));
+        attribute.CheckBelongsTo(MyRootGraph, kind);
+        return FFI.GraphvizFFI.GetAttributeColumn(_ptr, attribute._sym, kind == 2);
+    }
+
+    private void SetAttributeColumn(AttributeHandle attribute, int kind, IReadOnlyList<string> values)
+    {
+        _ = attribute ?? throw new ArgumentNullException(nameof(attribute));
+        _ = values ?? throw new ArgumentNullException(nameof(values));
+        attribute.CheckBelongsTo(MyRootGraph, kind);
+        var (data, offsets) = FFI.Marshaling.MarshalColumnToUtf8(values);
+        if (FFI.GraphvizFFI.SetAttributeColumn(_ptr, attribute._sym, kind == 2, data, offsets) < 0)
+            throw new ArgumentException("The number of values does not match the number of objects in the graph.", nameof(values));
+    }
+
+    /// <summary>
+    /// Compute a hash over the names of the nodes, the endpoints and names of the edges, the subgraphs and their
+    /// members, and the values of the given attributes for the graph, its subgraphs, nodes and edges.
+    /// The result does not depend on the order in which the graph was constructed, so it can be used to find out
+    /// cheaply whether a graph changed, e.g. since it was last laid out.
+    ///
+    /// Attributes that are not declared for a kind of object count as empty. Anonymous nodes and subgraphs are
+    /// identified by their internal id, which does depend on the order of construction.
+    /// </summary>
+    public GraphFingerprint ComputeFingerprint(IReadOnlyList<string> attributes)
+    {
+        _ = attributes ?? throw new ArgumentNullException(nameof(attributes));
+        var (data, offsets) = FFI.Marshaling.MarshalColumnToUtf8(attributes);
+        ulong[] result = RjGraphFingerprint(_ptr, data, offsets);
+        return new GraphFingerprint(result[0], result[1]);
+    }
+
+    /// <summary>
+    /// The names of the attributes that are declared in the root graph, for any kind of object.
+    /// </summary>
+    internal List<string> DeclaredAttributeNames()
+    {
+        var result = new List<string>();
+        for (int kind = 0; kind < 3; ++kind)
+        {
+            IntPtr sym = Agnxtattr(MyRootGraph._ptr, kind, IntPtr.Zero);
+            while (sym != IntPtr.Zero)
+            {
+                string? key = ImsymKey(sym);
+                if (key is not null && !result.Contains(key))
+                    result.Add(key);
+                sym = Agnxtattr(MyRootGraph._ptr, kind, sym);
+            }
+        }
+        return result;
+    }
+
     public IEnumerable<SubGraph> Children()
     {
         var current = Agfstsubg(_ptr);
@@ -113,9 +278,17 @@ public IEnumerable<Node> GetNodesByAttribute(string attr_name, string attr_value
         return Nodes().Where(n => n.GetAttribute(attr_name) == attr_value);
     }
 
-    public SubGraph GetDescendantByName(string name)
+    /// <summary>
+    /// Find a subgraph with the given name among the descendants of this graph. If several descendants have
+    /// that name, the first one in the order of <see cref="Descendants"/> is returned, unless some of them
+    /// were added after the first lookup in this root graph.
+    /// The lookup uses an index of the root graph, which is built on first use, and kept up to date afterwards.
+    /// </summary>
+    public SubGraph? GetDescendantByName(string name)
     {
-        return Descendants().FirstOrDefault(d => d.GetName() == name);
+        _ = name ?? throw new ArgumentNullException(nameof(name));
+        IntPtr ptr = RjFindDescendant(_ptr, name);
+        return ptr == IntPtr.Zero ? null : new SubGraph(ptr, MyRootGraph);
     }
 
     public SubGraph GetOrAddSubgraph(string name)
@@ -186,13 +359,40 @@ public override string ToString()
         return Rjagmemwrite(_ptr);
     }
 
+    /// <summary>
+    /// Write a compact binary snapshot of this graph to the stream, which can be read back with
+    /// <see cref="RootGraph.LoadSnapshot"/>. The snapshot holds the nodes, edges, subgraphs and attribute values,
+    /// but not the layout, unless it was stored in attributes. Like <see cref="ToDotString"/>,
+    /// a snapshot of a subgraph is read back as a root graph.
+    /// </summary>
+    public void SaveSnapshot(Stream stream)
+    {
+        _ = stream ?? throw new ArgumentNullException(nameof(stream));
+        RjWriteSnapshot(_ptr, stream);
+    }
+
     /// <summary>
     /// Attributes with the empty string as default are not correctly exported.
     /// https://gitlab.com/graphviz/graphviz/-/issues/1887
     /// </summary>
     public void ToDotFile(string filename)
     {
-        File.WriteAllText(filename, ToDotString());
+        using var stream = new FileStream(filename, FileMode.Create, FileAccess.Write);
+        WriteDot(stream);
+    }
+
+    /// <summary>
+    /// Write the graph in dot format to the given stream. The stream is not closed.
+    /// Graphviz writes the output into native chunks of 64 KB while the graph is locked, and the chunks are copied
+    /// to the stream after the lock is released, so other graphviz calls are not held up by a slow stream.
+    /// The trade-off is that the whole output lives in native memory until it is written. Chunks are freed as
+    /// they are written, and no managed string of the whole output is built.
+    /// </summary>
+    public void WriteDot(Stream stream)
+    {
+        _ = stream ?? throw new ArgumentNullException(nameof(stream));
+        if (!Rjagwrite(_ptr, stream))
+            throw new ApplicationException("Graphviz could not write the graph");
     }
 
     /// <summary>
@@ -218,79 +418,54 @@ public SubGraph AddSubgraphFromEdgeSet(string name, HashSet<Edge> edges)
     /// </summary>
     public SubGraph AddSubgraphFromNodes(string name, IEnumerable<Node> nodes)
     {
-#nullable disable
-        // Freeze the list of descendants,
-        // since we are going to add subgraphs while iterating over existing subgraphs
-        List<SubGraph> descendants = Descendants().ToList();
-
-        SubGraph result = GetOrAddSubgraph(name);
-        foreach (var node in nodes)
-            result.AddExisting(node);
-
-        Debug.Assert(result.Nodes().Count() == nodes.Count());
-
-        // All that remains to do is to patch up the result by adding edges and subgraphs
-        foreach (var node in result.Nodes())
-            foreach (var edge in node.EdgesOut(this))
-                if (result.Contains(edge.Head()))
-                    result.AddExisting(edge);
-
-        Debug.Assert(result.Nodes().Count() == nodes.Count());
-
-        // Iterate over the (frozen) existing subgraphs and add new filtered subgraphs
-        // in the same hierarchical position as their unfiltered counterparts.
-        foreach (var subgraph in descendants)
-        {
-            string filteredsubgraphname = name + ":" + subgraph.GetName();
-            Debug.WriteLine("Adding filtered subgraph {0}", filteredsubgraphname);
-            Graph parent = subgraph.Parent();
-            Graph filteredparent;
-            if (parent.Equals(this))
-                filteredparent = result;
-            else
-            {
-                string parentname = name + ":" + parent.GetName();
-                filteredparent = result.GetDescendantByName(parentname);
-                Debug.Assert(filteredparent != null);
-            }
-
-            _ = filteredparent.AddSubgraphFilteredByNodes(filteredsubgraphname, subgraph, nodes);
-        }
-
-        Debug.Assert(result.Nodes().Count() == nodes.Count());
-
-        // Remove subgraphs again if they are empty
-        // Again, we have to freeze the descendants we are enumerating, since we are disposing on the fly
-        result.SafeDeleteSubgraphs(s => !s.Nodes().Any());
-
-        Debug.Assert(result.Nodes().Count() == nodes.Count());
-
+        _ = name ?? throw new ArgumentNullException(nameof(name));
+        _ = nodes ?? throw new ArgumentNullException(nameof(nodes));
+        // The subgraph, its edges and the filtered copies of the descendants are built in a single call
+        var nodePtrs = nodes.Select(n => n._ptr).Distinct().ToArray();
+        IntPtr ptr = RjAddSubgraphFromNodes(_ptr, name, nodePtrs);
+        var result = new SubGraph(ptr, MyRootGraph);
+        Debug.Assert(result.Nodes().Count() == nodePtrs.Length);
         return result;
-#nullable enable
     }
 
     /// <summary>
     /// Delete all subgraphs in self fulfilling the predicate, without running into AccessViolationExceptions.
+    /// Subgraphs are deleted together with their descendants.
+    ///
+    /// The predicate is evaluated for all subgraphs before any of them is deleted, and the matches are deleted
+    /// in a single batch. Because a predicate may look at the descendants of a subgraph, for example to delete
+    /// empty subgraphs, a deletion can make the parent of the deleted subgraph match. Such a cascade moves up
+    /// one level per batch, so the evaluation is repeated at most as many times as subgraphs are nested.
+    ///
+    /// The predicate is called without holding any locks, so it may use other root graphs.
     /// </summary>
     public void SafeDeleteSubgraphs(Func<SubGraph, bool> predicate)
     {
-        // Everytime we delete something, we restart the loop.
-        // This is not efficient, but easy to implement for now.
-        bool work_to_do = true;
-
-        while (work_to_do)
+        _ = predicate ?? throw new ArgumentNullException(nameof(predicate));
+        int depth = NestingDepth();
+        for (int round = 0; round < depth; round++)
         {
-            work_to_do = false;
-            foreach (var subgraph in Descendants())
-            {
-                if (!predicate(subgraph)) continue;
-                subgraph.Delete();
-                work_to_do = true;
-                break;
-            }
+            var matches = Descendants().Where(predicate).Select(s => s._ptr).ToArray();
+            if (matches.Length == 0 || RjDeleteSubgraphs(_ptr, matches) == 0)
+                return;
         }
     }
 
+    private int NestingDepth()
+    {
+        return Children().Select(c => c.NestingDepth() + 1).DefaultIfEmpty(0).Max();
+    }
+
+    /// <summary>
+    /// Delete the given subgraphs of self, together with their descendants, in a single call.
+    /// Subgraphs that are not descendants of self are ignored.
+    /// </summary>
+    public void SafeDeleteSubgraphs(IEnumerable<SubGraph> subgraphs)
+    {
+        _ = subgraphs ?? throw new ArgumentNullException(nameof(subgraphs));
+        _ = RjDeleteSubgraphs(_ptr, subgraphs.Select(s => s._ptr).ToArray());
+    }
+
     /// <summary>
     /// Add a plain subgraph with given name to self, containing the nodes that occur both in origin
     /// and the filter. In other words, filter the origin subgraph by the filter subgraph on node-level.
@@ -301,7 +476,8 @@ public void SafeDeleteSubgraphs(Func<SubGraph, bool> predicate)
     public SubGraph AddSubgraphFilteredByNodes(string name, SubGraph origin, IEnumerable<Node> filter)
     {
         SubGraph result = GetOrAddSubgraph(name);
-        foreach (var node in origin.Nodes().Where(filter.Contains))
+        var filterSet = filter as ISet<Node> ?? new HashSet<Node>(filter);
+        foreach (var node in origin.Nodes().Where(filterSet.Contains))
             result.AddExisting(node);
 
         _ = origin.CopyAttributesTo(result);
@@ -317,84 +493,20 @@ public SubGraph AddSubgraphFilteredByNodes(string name, SubGraph origin, IEnumer
     /// <returns></returns>
     public RootGraph Clone(string resultname)
     {
-        RootGraph result = RootGraph.CreateNew(GetGraphType(), resultname);
-        _ = CopyAttributesTo(result);
-        CloneInto(result);
+        RootGraph result = RootGraph.CreateClone(this, resultname);
         result.UpdateMemoryPressure();
         return result;
     }
 
+    /// <summary>
+    /// Copy all nodes, edges and subgraphs contained in self into the target graph,
+    /// together with their attribute values. The subgraph hierarchy below self is preserved.
+    /// Nodes, edges and subgraphs that already exist in the target are reused.
+    /// </summary>
     public void CloneInto(RootGraph target)
     {
-#nullable disable
-        // Copy all nodes and edges
-        foreach (var node in Nodes())
-        {
-            string nodename = node.GetName();
-            Node newnode = target.GetOrAddNode(nodename);
-
-            foreach (var edge in node.EdgesOut(this))
-            {
-                Node head = edge.Head();
-                Debug.Assert(Contains(head));
-                Node tail = edge.Tail();
-                Debug.Assert(node.Equals(tail));
-                string headname = head.GetName();
-                Node newhead = target.GetOrAddNode(headname);
-                string tailname = tail.GetName();
-                Node newtail = target.GetNode(tailname);
-
-                string edgename = edge.GetName();
-                Edge newedge = target.GetOrAddEdge(newtail, newhead, edgename);
-                _ = edge.CopyAttributesTo(newedge);
-            }
-            _ = node.CopyAttributesTo(newnode);
-        }
-
-        // Copy all subgraphs
-        foreach (var subgraph in Descendants())
-        {
-            string subgraphname = subgraph.GetName();
-            Graph parent = subgraph.Parent();
-            Graph newparent;
-            if (parent.Equals(this))
-                newparent = target;
-            else
-            {
-                string parentname = parent.GetName();
-                newparent = target.GetDescendantByName(parentname);
-                Debug.Assert(newparent != null);
-            }
-            SubGraph newsubgraph = newparent.GetOrAddSubgraph(subgraphname);
-            _ = subgraph.CopyAttributesTo(newsubgraph);
-
-            // Add the (already created) nodes and edges to newly created subgraph
-            foreach (var node in subgraph.Nodes())
-            {
-                string nodename = node.GetName();
-                Node newnode = target.GetNode(nodename);
-                Debug.Assert(newnode != null);
-                newsubgraph.AddExisting(newnode);
-
-                foreach (var edge in node.EdgesOut(subgraph))
-                {
-                    Node head = edge.Head();
-                    Node tail = edge.Tail();
-                    Debug.Assert(node.Equals(tail));
-
-                    string headname = head.GetName();
-                    Node newhead = target.GetNode(headname);
-                    string tailname = tail.GetName();
-                    Node newtail = target.GetNode(tailname);
-
-                    string edgename = edge.GetName();
-                    Edge newedge = target.GetEdge(newtail, newhead, edgename);
-                    newsubgraph.AddExisting(newedge);
-                }
-                _ = node.CopyAttributesTo(newnode);
-            }
-        }
-#nullable enable
+        _ = target ?? throw new ArgumentNullException(nameof(target));
+        RjCloneInto(_ptr, target._ptr);
     }
 
     /// <summary>
@@ -575,6 +687,24 @@ public RootGraph CreateLayout(string engine = LayoutEngines.Dot, CoordinateSyste
         return GraphvizCommand.CreateLayout(this, engine, coordinateSystem);
     }
 
+    /// <summary>
+    /// Compute the layout in one or more separate processes, see <see cref="LayoutOptions"/>,
+    /// and return a new graph, which is a copy of the old graph with the xdot information added to it.
+    /// </summary>
+    public RootGraph CreateLayout(LayoutOptions options)
+    {
+        return GraphvizCommand.CreateLayout(this, options);
+    }
+
+    /// <summary>
+    /// Compute the layout in a separate process without blocking, see <see cref="GraphvizCommand.CreateLayoutAsync"/>.
+    /// </summary>
+    public Task<RootGraph> CreateLayoutAsync(string engine = LayoutEngines.Dot, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft,
+        TimeSpan? timeout = null, CancellationToken cancellationToken = default)
+    {
+        return GraphvizCommand.CreateLayoutAsync(this, engine, coordinateSystem, timeout, cancellationToken);
+    }
+
     /// <summary>
     /// Untransformed boundingbox. Still needs to be transformed to the desired coordinate system.
     /// </summary>
@@ -611,6 +741,18 @@ private byte[] ToBytes(string format, string engine)
         return stdout;
     }
 
+    /// <summary>
+    /// Render the graph in the given output format in a separate process without blocking,
+    /// see <see cref="GraphvizCommand.ExecAsync"/>.
+    /// </summary>
+    public async Task<byte[]> ToBytesAsync(string format, string engine = LayoutEngines.Dot, TimeSpan? timeout = null,
+        CancellationToken cancellationToken = default)
+    {
+        var (stdout, _) = await GraphvizCommand.ExecAsync(this, format: format, engine: engine, timeout: timeout,
+            cancellationToken: cancellationToken).ConfigureAwait(false);
+        return stdout;
+    }
+
     public void ToXDotFile(string filepath, string engine = LayoutEngines.Dot) => ToFile(filepath, "xdot", engine);
     public void ToSvgFile(string filepath, string engine = LayoutEngines.Dot) => ToFile(filepath, "svg", engine);
     public void ToPngFile(string filepath, string engine = LayoutEngines.Dot) => ToFile(filepath, "png", engine);
@@ -634,10 +776,34 @@ private byte[] ToBytes(string format, string engine)
     /// Moreover, experience shows it is less likely to trip over lingering graphviz bugs as well.
     /// NB: The method FreeLayout should always be called as soon as the layout information
     /// of a graph is not needed anymore.
+    /// When <see cref="RootGraph.ContextPool"/> is set, the layout is computed with a context of that pool,
+    /// which this graph keeps until <see cref="FreeLayout"/> is called.
     /// </summary>
     public void ComputeLayout(string engine = LayoutEngines.Dot)
     {
-        int layout_rc = GvLayout(GVC, _ptr, engine);
+        var pool = RootGraph.ContextPool;
+        if (pool is null)
+        {
+            ComputeLayout(GVC, engine);
+            return;
+        }
+
+        var context = pool.Acquire();
+        try
+        {
+            ComputeLayout(context.Ptr, engine);
+        }
+        catch
+        {
+            pool.Release(context, healthy: false);
+            throw;
+        }
+        MyRootGraph.SetLayoutContext(_ptr, pool, context);
+    }
+
+    private void ComputeLayout(IntPtr gvc, string engine)
+    {
+        int layout_rc = GvLayout(gvc, _ptr, engine);
         if (layout_rc != 0)
             throw new ApplicationException($"Graphviz layout returned error code {layout_rc}");
 
@@ -645,7 +811,7 @@ public void ComputeLayout(string engine = LayoutEngines.Dot)
         // The engine specified here doesn't have to be the same as the above.
         // We always want to use xdot here, independently of the layout algorithm,
         // to ensure a consistent attribute layout.
-        int render_rc = GvRender(GVC, _ptr, "xdot", IntPtr.Zero);
+        int render_rc = GvRender(gvc, _ptr, "xdot", IntPtr.Zero);
         if (render_rc != 0)
             throw new ApplicationException($"Graphviz render returned error code {render_rc}");
     }
@@ -658,7 +824,8 @@ public void ComputeLayout(string engine = LayoutEngines.Dot)
     /// </summary>
     public void FreeLayout()
     {
-        var free_rc = GvFreeLayout(GVC, _ptr);
+        var free_rc = GvFreeLayout(MyRootGraph.LayoutContext(_ptr), _ptr);
+        MyRootGraph.SetLayoutContext(_ptr, null, null);
         if (free_rc != 0)
             throw new ApplicationException($"Graphviz render returned error code {free_rc}");
     }
@@ -669,10 +836,34 @@ public void FreeLayout()
     [Obsolete("This method is only available after ComputeLayout(), and may crash otherwise. It is obsoleted by the other ToXXXFile methods.")]
     public void RenderToFile(string filename, string format)
     {
-        var render_rc = GvRenderFilename(GVC, _ptr, format, filename);
+        var render_rc = GvRenderFilename(MyRootGraph.LayoutContext(_ptr), _ptr, format, filename);
         if (render_rc != 0)
             throw new ApplicationException($"Graphviz render returned error code {render_rc}");
     }
 
+    /// <summary>
+    /// Render the layout computed by <see cref="ComputeLayout"/> in the given output format, in-process.
+    /// Unlike <see cref="ToSvgString"/> and friends, this does not start a process and does not compute the layout again.
+    /// Throws an <see cref="ApplicationException"/> if the graph has no layout or the format is not supported.
+    /// </summary>
+    public byte[] RenderToBytes(string format)
+    {
+        _ = format ?? throw new ArgumentNullException(nameof(format));
+        var render_rc = GvRenderData(MyRootGraph.LayoutContext(_ptr), _ptr, format, out byte[] result);
+        if (render_rc != 0)
+            throw new ApplicationException($"Graphviz render returned error code {render_rc}");
+        return result;
+    }
+
+    /// <summary>
+    /// Write the layout computed by <see cref="ComputeLayout"/> to the given stream, see <see cref="RenderToBytes"/>.
+    /// </summary>
+    public void RenderToStream(Stream stream, string format)
+    {
+        _ = stream ?? throw new ArgumentNullException(nameof(stream));
+        var bytes = RenderToBytes(format);
+        stream.Write(bytes, 0, bytes.Length);
+    }
+
     #endregion
 }
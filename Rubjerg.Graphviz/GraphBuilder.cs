@@ -0,0 +1,153 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// Collects the nodes, edges and attribute values of a new graph in managed memory, and then creates the
+/// whole root graph in a single call into graphviz. This is much faster than calling
+/// <see cref="Graph.GetOrAddNode"/> and <see cref="Graph.GetOrAddEdge"/> for every element of a large graph.
+///
+/// Nodes are identified by the index returned by <see cref="AddNode"/>, which is also their position
+/// in <see cref="Graph.Nodes"/> of the result.
+/// </summary>
+public sealed class GraphBuilder
+{
+    private sealed class AttributeColumn
+    {
+        public AttributeColumn(int kind, string name, string deflt, IReadOnlyList<string> values)
+        {
+            Kind = kind;
+            Name = name;
+            Default = deflt;
+            Values = values;
+        }
+
+        public int Kind { get; }
+        public string Name { get; }
+        public string Default { get; }
+        public IReadOnlyList<string> Values { get; }
+    }
+
+    private readonly List<string> _nodeNames = new List<string>();
+    private readonly Dictionary<string, int> _nodeIndices = new Dictionary<string, int>();
+    private readonly List<string> _edgeNames = new List<string>();
+    private readonly List<int> _tails = new List<int>();
+    private readonly List<int> _heads = new List<int>();
+    private readonly List<int> _edgeNameIndices = new List<int>();
+    private readonly List<AttributeColumn> _attributes = new List<AttributeColumn>();
+
+    public GraphType GraphType { get; }
+    public string? Name { get; }
+    public int NodeCount => _nodeNames.Count;
+    public int EdgeCount => _tails.Count;
+
+    public GraphBuilder(GraphType graphType = GraphType.Directed, string? name = null)
+    {
+        GraphType = graphType;
+        Name = name;
+    }
+
+    /// <returns>The index of the node with the given name, which is only added if it did not exist yet</returns>
+    public int AddNode(string name)
+    {
+        if (string.IsNullOrEmpty(name))
+            throw new ArgumentException("Node names must not be empty.", nameof(name));
+        if (!_nodeIndices.TryGetValue(name, out int index))
+        {
+            index = _nodeNames.Count;
+            _nodeNames.Add(name);
+            _nodeIndices.Add(name, index);
+        }
+        return index;
+    }
+
+    /// <summary>
+    /// Add an edge between the nodes with the given indices. Unnamed edges are always added,
+    /// unless the graph is strict, in which case graphviz merges edges between the same nodes.
+    /// </summary>
+    /// <returns>The index of the edge, which is its position in the edge attribute columns</returns>
+    public int AddEdge(int tail, int head, string? name = null)
+    {
+        if (tail < 0 || tail >= NodeCount)
+            throw new ArgumentOutOfRangeException(nameof(tail));
+        if (head < 0 || head >= NodeCount)
+            throw new ArgumentOutOfRangeException(nameof(head));
+        int nameIndex = -1;
+        if (!string.IsNullOrEmpty(name))
+        {
+            nameIndex = _edgeNames.Count;
+            _edgeNames.Add(name!);
+        }
+        _tails.Add(tail);
+        _heads.Add(head);
+        _edgeNameIndices.Add(nameIndex);
+        return _tails.Count - 1;
+    }
+
+    /// <summary>
+    /// Add an edge between the nodes with the given names, adding the nodes if they do not exist yet.
+    /// </summary>
+    public int AddEdge(string tail, string head, string? name = null)
+    {
+        return AddEdge(AddNode(tail), AddNode(head), name);
+    }
+
+    /// <summary>
+    /// Set the value of the given attribute for every node, in the order of the node indices.
+    /// The number of values must equal <see cref="NodeCount"/> when the graph is built.
+    /// </summary>
+    public void SetNodeAttributeColumn(string name, IReadOnlyList<string> values, string deflt = "")
+    {
+        AddAttributeColumn(1, name, values, deflt);
+    }
+
+    /// <summary>
+    /// Set the value of the given attribute for every edge, in the order of the edge indices.
+    /// The number of values must equal <see cref="EdgeCount"/> when the graph is built.
+    /// </summary>
+    public void SetEdgeAttributeColumn(string name, IReadOnlyList<string> values, string deflt = "")
+    {
+        AddAttributeColumn(2, name, values, deflt);
+    }
+
+    private void AddAttributeColumn(int kind, string name, IReadOnlyList<string> values, string deflt)
+    {
+        if (string.IsNullOrEmpty(name))
+            throw new ArgumentException("Attribute names must not be empty.", nameof(name));
+        _ = values ?? throw new ArgumentNullException(nameof(values));
+        _ = deflt ?? throw new ArgumentNullException(nameof(deflt));
+        _attributes.Add(new AttributeColumn(kind, name, deflt, values));
+    }
+
+    /// <summary>
+    /// Create the graph. The builder can be used again afterwards, to add more elements and build another graph.
+    /// </summary>
+    public RootGraph Build(CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
+    {
+        foreach (var column in _attributes)
+        {
+            int expected = column.Kind == 1 ? NodeCount : EdgeCount;
+            if (column.Values.Count != expected)
+                throw new InvalidOperationException(
+                    $"The attribute column {column.Name} has {column.Values.Count} values, but there are {expected} {(column.Kind == 1 ? "nodes" : "edges")}.");
+        }
+
+        // One table of strings: the node names, the edge names, and the name, default and values of every attribute
+        var strings = new List<string>(_nodeNames.Count + _edgeNames.Count + _attributes.Sum(a => a.Values.Count + 2));
+        strings.AddRange(_nodeNames);
+        strings.AddRange(_edgeNames);
+        foreach (var column in _attributes)
+        {
+            strings.Add(column.Name);
+            strings.Add(column.Default);
+            strings.AddRange(column.Values.Select(v => v ?? ""));
+        }
+        var (data, offsets) = FFI.Marshaling.MarshalColumnToUtf8(strings);
+
+        return RootGraph.CreateFromTables(Name, GraphType, data, offsets, NodeCount, _edgeNames.Count,
+            _tails.ToArray(), _heads.ToArray(), _edgeNameIndices.ToArray(),
+            _attributes.Select(a => a.Kind).ToArray(), coordinateSystem);
+    }
+}
@@ -1,82 +1,51 @@
 ﻿using System;
 using System.Collections.Generic;
-using System.Linq;
+using System.Globalization;
+using static Rubjerg.Graphviz.FFI.GraphvizFFI;
 
 namespace Rubjerg.Graphviz;
 
 public static class GraphComparer
 {
+    /// <summary>
+    /// Check whether A and B contain the same nodes, and whether every node has the same outgoing edges
+    /// in both graphs, where edges are identified by their name and head. The differences are logged.
+    /// </summary>
     public static bool CheckTopologicallyEquals(Graph A, Graph B, Action<string> logger)
     {
+        _ = logger ?? throw new ArgumentNullException(nameof(logger));
         logger($"Comparing graph A = '{A.GetName()}' with graph B = '{B.GetName()}'");
         logger("");
 
-        bool result = true;
-        var common_nodenames = new List<string?>();
-        foreach (var node in A.Nodes())
-        {
-            var othernode = B.GetNode(node.GetName());
-            if (othernode is null)
-            {
-                logger($"graph B does not contain node {node.GetName()}");
-                result = false;
-            }
-            else
-            {
-                common_nodenames.Add(node.GetName());
-            }
-        }
-
-        foreach (var node in B.Nodes())
-        {
-            var othernode = A.GetNode(node.GetName());
-            if (othernode is null)
-            {
-                logger($"graph A does not contain node {node.GetName()}");
-                result = false;
-            }
-        }
-
-        foreach (var nodename in common_nodenames)
-        {
-            result &= CheckNode(A, B, A.GetNode(nodename), B.GetNode(nodename), logger);
-        }
+        var differences = Compare(A, B);
+        foreach (var difference in differences)
+            logger(difference.ToString());
+        bool result = differences.Count == 0;
 
         logger("");
         logger($"A and B are {(result ? "" : "NOT")} topologically equivalent");
         return result;
     }
 
-    private static bool CheckNode(Graph A, Graph B, Node? nA, Node? nB, Action<string> logger)
+    /// <summary>
+    /// Compute the differences between A and B. Nodes are matched by name, and the outgoing edges of
+    /// matching nodes are matched by name and head. Parallel edges with the same name and head are
+    /// not distinguished.
+    ///
+    /// If compareAttributes is set, the attribute values of the graphs themselves, of the matching nodes
+    /// and of the matching edges are compared as well. An attribute that is not declared in one of the
+    /// graphs is taken to have the empty value there.
+    ///
+    /// The comparison runs in the wrapper library, in time linear in the size of both graphs.
+    /// </summary>
+    public static IReadOnlyList<GraphDifference> Compare(Graph A, Graph B, bool compareAttributes = false)
     {
-        return nA is not null && nB is not null && InnerCheckNode(A, B, nA, nB, logger, "B") & InnerCheckNode(B, A, nA, nB, logger, "A");
-    }
-
-    private static bool InnerCheckNode(Graph A, Graph B, Node nA, Node nB, Action<string> logger, string nameOfGraphOfNodeB)
-    {
-        bool result = true;
-        foreach (var eA in nA.EdgesOut(A))
-        {
-            var expected_endpoint = eA.OppositeEndpoint(nA);
-            bool diff = false;
-            if (!nB.EdgesOut(B).Any(eB => CheckEdgeName(eA, eB)))
-            {
-                logger($@"In graph {nameOfGraphOfNodeB} the node '{nB.GetName()}' does not have an outgoing edge with name '{eA.GetName()}'");
-                result = false;
-                diff = true;
-            }
-            if (!nB.EdgesOut(B).Any(eB => CheckEdgeEndpoints(eA, eB)))
-            {
-                logger($@"In graph {nameOfGraphOfNodeB} the node '{nB.GetName()}' does not have an outgoing edge with head '{expected_endpoint.GetName()}'");
-                result = false;
-                diff = true;
-            }
-            if (!diff && !nB.EdgesOut(B).Any(eB => CheckEdge(eA, eB)))
-            {
-                logger($@"In graph {nameOfGraphOfNodeB} the node '{nB.GetName()}' does not have an outgoing edge with **both** name '{eA.GetName()}' and head '{expected_endpoint.GetName()}'");
-                result = false;
-            }
-        }
+        _ = A ?? throw new ArgumentNullException(nameof(A));
+        _ = B ?? throw new ArgumentNullException(nameof(B));
+        string[] values = RjCompareGraphs(A._ptr, B._ptr, compareAttributes);
+        var result = new List<GraphDifference>(values.Length / GraphDifference.FieldCount);
+        for (int i = 0; i + GraphDifference.FieldCount <= values.Length; i += GraphDifference.FieldCount)
+            result.Add(new GraphDifference(values, i));
         return result;
     }
 
@@ -96,3 +65,80 @@ public static bool CheckEdgeEndpoints(Edge eA, Edge eB)
     }
 
 }
+
+public enum GraphDifferenceKind
+{
+    /// <summary>A node of one graph does not occur in the other graph.</summary>
+    MissingNode = 0,
+    /// <summary>An edge of one graph does not occur in the other graph, and neither does an edge with the same name.</summary>
+    MissingEdge = 1,
+    /// <summary>The other graph contains an outgoing edge of the tail with the same name, but with a different head.</summary>
+    EdgeEndpointMismatch = 2,
+    /// <summary>An attribute has different values in the two graphs.</summary>
+    AttributeMismatch = 3,
+}
+
+/// <summary>
+/// A single difference between two graphs A and B, as reported by <see cref="GraphComparer.Compare"/>.
+/// </summary>
+public sealed class GraphDifference
+{
+    internal const int FieldCount = 8;
+
+    public GraphDifferenceKind Kind { get; }
+    /// <summary>
+    /// The graph that lacks the node or edge, "A" or "B". Null for attribute mismatches.
+    /// </summary>
+    public string? MissingIn { get; }
+    /// <summary>
+    /// The name of the missing node, the tail of the edge, or the node whose attribute differs.
+    /// Null for attributes of the graphs themselves.
+    /// </summary>
+    public string? NodeName { get; }
+    /// <summary>
+    /// The name of the head of the edge, if the difference concerns an edge.
+    /// </summary>
+    public string? HeadName { get; }
+    /// <summary>
+    /// The name of the edge, or null if the edge is anonymous or the difference does not concern an edge.
+    /// </summary>
+    public string? EdgeName { get; }
+    public string? AttributeName { get; }
+    public string? ValueA { get; }
+    public string? ValueB { get; }
+
+    internal GraphDifference(string[] values, int offset)
+    {
+        Kind = (GraphDifferenceKind)int.Parse(values[offset], CultureInfo.InvariantCulture);
+        MissingIn = NullIfEmpty(values[offset + 1]);
+        NodeName = NullIfEmpty(values[offset + 2]);
+        HeadName = NullIfEmpty(values[offset + 3]);
+        EdgeName = NullIfEmpty(values[offset + 4]);
+        AttributeName = NullIfEmpty(values[offset + 5]);
+        if (Kind == GraphDifferenceKind.AttributeMismatch)
+        {
+            ValueA = values[offset + 6];
+            ValueB = values[offset + 7];
+        }
+    }
+
+    private static string? NullIfEmpty(string value) => value.Length == 0 ? null : value;
+
+    public override string ToString()
+    {
+        switch (Kind)
+        {
+            case GraphDifferenceKind.MissingNode:
+                return $"graph {MissingIn} does not contain node {NodeName}";
+            case GraphDifferenceKind.MissingEdge:
+                return $"In graph {MissingIn} the node '{NodeName}' does not have an outgoing edge with name '{EdgeName}' and head '{HeadName}'";
+            case GraphDifferenceKind.EdgeEndpointMismatch:
+                return $"In graph {MissingIn} the outgoing edge with name '{EdgeName}' of node '{NodeName}' does not have head '{HeadName}'";
+            default:
+                string subject = NodeName is null ? "the graph"
+                    : HeadName is null ? $"node '{NodeName}'"
+                    : $"edge '{NodeName}' -> '{HeadName}' with name '{EdgeName}'";
+                return $"The attribute '{AttributeName}' of {subject} has value '{ValueA}' in graph A and value '{ValueB}' in graph B";
+        }
+    }
+}
@@ -0,0 +1,46 @@
+using System;
+using System.Globalization;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// A 128 bit hash of the structure of a graph and a chosen set of attribute values,
+/// as computed by <see cref="Graph.ComputeFingerprint"/>.
+/// Fingerprints do not depend on the order in which nodes, edges and subgraphs were added,
+/// and are stable across processes and platforms, so they can be stored.
+/// </summary>
+public readonly struct GraphFingerprint : IEquatable<GraphFingerprint>
+{
+    public ulong High { get; }
+    public ulong Low { get; }
+
+    public GraphFingerprint(ulong high, ulong low)
+    {
+        High = high;
+        Low = low;
+    }
+
+    /// <summary>
+    /// Parse the 32 hexadecimal digits produced by <see cref="ToString"/>.
+    /// </summary>
+    public static GraphFingerprint Parse(string value)
+    {
+        _ = value ?? throw new ArgumentNullException(nameof(value));
+        if (value.Length != 32)
+            throw new FormatException("A fingerprint consists of 32 hexadecimal digits.");
+        return new GraphFingerprint(
+            ulong.Parse(value.Substring(0, 16), NumberStyles.AllowHexSpecifier, CultureInfo.InvariantCulture),
+            ulong.Parse(value.Substring(16), NumberStyles.AllowHexSpecifier, CultureInfo.InvariantCulture));
+    }
+
+    public bool Equals(GraphFingerprint other) => High == other.High && Low == other.Low;
+    public override bool Equals(object? obj) => obj is GraphFingerprint other && Equals(other);
+    public override int GetHashCode() => Low.GetHashCode();
+    public static bool operator ==(GraphFingerprint left, GraphFingerprint right) => left.Equals(right);
+    public static bool operator !=(GraphFingerprint left, GraphFingerprint right) => !left.Equals(right);
+
+    public override string ToString()
+    {
+        return High.ToString("x16", CultureInfo.InvariantCulture) + Low.ToString("x16", CultureInfo.InvariantCulture);
+    }
+}
@@ -5,6 +5,11 @@
 using System.Text;
 using System.Runtime.InteropServices;
 using System.Linq;
+using System.Collections.Generic;
+using System.Globalization;
+using System.Runtime.ExceptionServices;
+using System.Threading;
+using System.Threading.Tasks;
 
 namespace Rubjerg.Graphviz;
 
@@ -52,15 +57,202 @@ internal static string Rid
     });
     internal static string DotExePath => _DotExePath.Value;
 
+    /// <summary>
+    /// When set, <see cref="CreateLayout"/> uses the long-lived dot processes of this pool,
+    /// instead of starting a new dot process for every layout.
+    /// </summary>
+    public static GraphvizWorkerPool? WorkerPool { get; set; }
+
+    /// <summary>
+    /// When set, <see cref="CreateLayout"/> first looks up the layout in this cache,
+    /// and stores the layouts it computes in there.
+    /// </summary>
+    public static LayoutCache? LayoutCache { get; set; }
+
     public static RootGraph CreateLayout(Graph input, string engine = LayoutEngines.Dot, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
     {
-        var (stdout, stderr) = Exec(input, engine: engine);
-        var stdoutStr = ConvertBytesOutputToString(stdout);
-        var resultGraph = RootGraph.FromDotString(stdoutStr, coordinateSystem);
+        if (LayoutCache is LayoutCache cache)
+            return cache.CreateLayout(input, engine, coordinateSystem, ExecXDot);
+
+        var (xdot, stderr) = ExecXDot(input, engine);
+        var resultGraph = RootGraph.FromDotString(xdot, coordinateSystem);
         resultGraph.Warnings = stderr;
         return resultGraph;
     }
 
+    /// <summary>
+    /// Compute the layouts of many graphs, without starting a dot process for each of them.
+    /// The graphs are streamed through a single long-lived dot process, or through the <see cref="WorkerPool"/>
+    /// if one is installed. Layouts in the <see cref="LayoutCache"/> are reused.
+    ///
+    /// The results are produced lazily, in the order of the inputs. A graph that cannot be laid out does not
+    /// stop the batch: its result carries the error instead, and a crashed dot process is replaced.
+    /// </summary>
+    public static IEnumerable<LayoutResult> CreateLayouts(IEnumerable<Graph> inputs, string engine = LayoutEngines.Dot,
+        CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
+    {
+        _ = inputs ?? throw new ArgumentNullException(nameof(inputs));
+        return CreateLayoutsIterator(inputs, engine, coordinateSystem);
+    }
+
+    private static IEnumerable<LayoutResult> CreateLayoutsIterator(IEnumerable<Graph> inputs, string engine, CoordinateSystem coordinateSystem)
+    {
+        GraphvizWorker? worker = null;
+        (string xdot, string stderr) exec(Graph input)
+        {
+            if (WorkerPool is GraphvizWorkerPool pool)
+                return pool.Exec(input, engine);
+            if (worker is not null && !worker.IsAlive)
+            {
+                worker.Dispose();
+                worker = null;
+            }
+            worker ??= new GraphvizWorker(engine);
+            return worker.Run(input.ToDotString() ?? "");
+        }
+
+        LayoutResult layout(Graph input)
+        {
+            try
+            {
+                if (LayoutCache is LayoutCache cache)
+                    return new LayoutResult(input, cache.CreateLayout(input, engine, coordinateSystem, (g, _) => exec(g)), null);
+
+                var (xdot, stderr) = exec(input);
+                var resultGraph = RootGraph.FromDotString(xdot, coordinateSystem);
+                resultGraph.Warnings = stderr;
+                return new LayoutResult(input, resultGraph, null);
+            }
+            catch (Exception e) when (e is ApplicationException || e is InvalidOperationException)
+            {
+                return new LayoutResult(input, null, e);
+            }
+        }
+
+        try
+        {
+            foreach (var input in inputs)
+                yield return layout(input);
+        }
+        finally
+        {
+            worker?.Dispose();
+        }
+    }
+
+    public static RootGraph CreateLayout(Graph input, LayoutOptions options)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        _ = options ?? throw new ArgumentNullException(nameof(options));
+        if (!options.SplitComponents)
+            return CreateLayout(input, options.Engine, options.CoordinateSystem);
+
+        var components = RootGraph.SplitComponents(input);
+        try
+        {
+            if (components.Length <= 1)
+                return CreateLayout(input, options.Engine, options.CoordinateSystem);
+            return CreateComponentLayout(input, components, options);
+        }
+        finally
+        {
+            foreach (var component in components)
+                component.Close();
+        }
+    }
+
+    private static RootGraph CreateComponentLayout(Graph input, RootGraph[] components, LayoutOptions options)
+    {
+        bool hasLabel = !string.IsNullOrEmpty(input.GetAttribute("label"));
+        var layouts = new RootGraph[components.Length];
+        try
+        {
+            var parallelOptions = new ParallelOptions { MaxDegreeOfParallelism = Math.Max(1, options.MaxDegreeOfParallelism) };
+            _ = Parallel.For(0, components.Length, parallelOptions, i =>
+            {
+                if (hasLabel)
+                    components[i].SetAttribute("label", "");
+                layouts[i] = CreateLayout(components[i], options.Engine);
+            });
+        }
+        catch (AggregateException e) when (e.InnerExceptions.Count > 0)
+        {
+            ExceptionDispatchInfo.Capture(e.InnerExceptions[0]).Throw();
+        }
+
+        try
+        {
+            var boxes = layouts.Select(l => l.RawBoundingBox()).ToList();
+            var offsets = PackRectangles(boxes, options.ComponentMargin, out double width, out double height);
+            var result = RootGraph.CreateClone(input, input.GetName(), options.CoordinateSystem);
+            for (int i = 0; i < layouts.Length; i++)
+                FFI.GraphvizFFI.RjMergeLayout(result._ptr, layouts[i]._ptr, offsets[i].X, offsets[i].Y);
+
+            result.SetAttribute("bb", string.Format(CultureInfo.InvariantCulture, "0,0,{0},{1}", width, height));
+            result.SetAttribute("xdotversion", layouts[0].GetAttribute("xdotversion"));
+            result.Warnings = string.Concat(layouts.Select(l => l.Warnings));
+            result.UpdateMemoryPressure();
+            return result;
+        }
+        finally
+        {
+            foreach (var layout in layouts)
+                layout?.Close();
+        }
+    }
+
+    /// <summary>
+    /// Place the rectangles in rows, from the top down, sorted by decreasing height. The rows are about
+    /// as wide as the square root of the total area, such that the result is roughly square, like the
+    /// array mode of the graphviz pack library.
+    /// </summary>
+    /// <returns>the translation of each rectangle, such that the result has its origin at (0, 0)</returns>
+    internal static PointD[] PackRectangles(IReadOnlyList<RectangleD> boxes, double margin, out double width, out double height)
+    {
+        double area = boxes.Sum(b => (b.Width + margin) * (b.Height + margin));
+        double rowWidth = Math.Max(Math.Sqrt(area), boxes.Max(b => b.Width));
+
+        // Positions relative to the top left corner, with y pointing down
+        var positions = new PointD[boxes.Count];
+        double x = 0;
+        double y = 0;
+        double currentRowHeight = 0;
+        width = 0;
+        foreach (int i in Enumerable.Range(0, boxes.Count).OrderByDescending(i => boxes[i].Height))
+        {
+            if (x > 0 && x + boxes[i].Width > rowWidth)
+            {
+                y += currentRowHeight + margin;
+                x = 0;
+                currentRowHeight = 0;
+            }
+            positions[i] = new PointD(x, y);
+            width = Math.Max(width, x + boxes[i].Width);
+            x += boxes[i].Width + margin;
+            currentRowHeight = Math.Max(currentRowHeight, boxes[i].Height);
+        }
+        height = y + currentRowHeight;
+
+        // Graphviz puts the origin at the bottom left
+        var offsets = new PointD[boxes.Count];
+        for (int i = 0; i < boxes.Count; i++)
+        {
+            double top = height - positions[i].Y;
+            offsets[i] = new PointD(positions[i].X - boxes[i].X, top - boxes[i].Height - boxes[i].Y);
+        }
+        return offsets;
+    }
+
+    /// <returns>the xdot output and stderr, both with unix line endings</returns>
+    private static (string xdot, string stderr) ExecXDot(Graph input, string engine)
+    {
+        if (WorkerPool is GraphvizWorkerPool pool)
+            return pool.Exec(input, engine);
+
+        var (stdout, stderr) = Exec(input, engine: engine);
+        return (ConvertBytesOutputToString(stdout), stderr);
+    }
+
     public static string ConvertBytesOutputToString(byte[] data)
     {
         // Just to be safe, make sure the input has unix line endings. Graphviz does not properly support
@@ -69,19 +261,10 @@ public static string ConvertBytesOutputToString(byte[] data)
     }
 
     /// <summary>
-    /// Start dot.exe to compute a layout.
+    /// Create a dot process with redirected input and output streams. The process is not started yet.
     /// </summary>
-    /// <exception cref="ApplicationException">When the Graphviz process did not return successfully</exception>
-    /// <returns>stderr may contain warnings, stdout is in utf8 encoding</returns>
-    public static (byte[] stdout, string stderr) Exec(Graph input, string format = "xdot", string? outputPath = null, string engine = LayoutEngines.Dot)
+    internal static Process CreateDotProcess(string arguments)
     {
-        string arguments = $"-T{format} -K{engine}";
-        if (outputPath != null)
-        {
-            arguments = $"{arguments} -o\"{outputPath}\"";
-        }
-        string? inputToStdin = input.ToDotString();
-
         Process process = new Process();
 
         process.StartInfo.FileName = DotExePath;
@@ -97,6 +280,24 @@ public static (byte[] stdout, string stderr) Exec(Graph input, string format = "
         // In some situations starting a new process also starts a new console window, which is distracting and causes slowdown.
         // This flag prevents this from happening.
         process.StartInfo.WindowStyle = ProcessWindowStyle.Hidden;
+        return process;
+    }
+
+    /// <summary>
+    /// Start dot.exe to compute a layout.
+    /// </summary>
+    /// <exception cref="ApplicationException">When the Graphviz process did not return successfully</exception>
+    /// <returns>stderr may contain warnings, stdout is in utf8 encoding</returns>
+    public static (byte[] stdout, string stderr) Exec(Graph input, string format = "xdot", string? outputPath = null, string engine = LayoutEngines.Dot)
+    {
+        string arguments = $"-T{format} -K{engine}";
+        if (outputPath != null)
+        {
+            arguments = $"{arguments} -o\"{outputPath}\"";
+        }
+        string? inputToStdin = input.ToDotString();
+
+        Process process = CreateDotProcess(arguments);
 
         StringBuilder stderr = new StringBuilder();
         process.ErrorDataReceived += (_, e) => stderr.AppendLine(e.Data);
@@ -131,5 +332,127 @@ public static (byte[] stdout, string stderr) Exec(Graph input, string format = "
             return (stdout, stderr.ToString().Replace("\r\n", "\n"));
         }
     }
+
+    /// <summary>
+    /// Compute the layout in a separate dot process, without blocking a thread while dot runs.
+    /// Unlike <see cref="CreateLayout(Graph, string, CoordinateSystem)"/>, this always starts a new process,
+    /// such that it can be killed on cancellation, but it does consult the <see cref="LayoutCache"/>.
+    /// See <see cref="ExecAsync"/> for the handling of timeouts and cancellation.
+    /// </summary>
+    public static async Task<RootGraph> CreateLayoutAsync(Graph input, string engine = LayoutEngines.Dot,
+        CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft, TimeSpan? timeout = null,
+        CancellationToken cancellationToken = default)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        var cache = LayoutCache;
+        string? key = cache?.CreateKey(input, engine);
+        if (cache is null || !cache.TryGet(key!, out string xdot, out string warnings))
+        {
+            var (stdout, stderr) = await ExecAsync(input, engine: engine, timeout: timeout, cancellationToken: cancellationToken)
+                .ConfigureAwait(false);
+            xdot = ConvertBytesOutputToString(stdout);
+            warnings = stderr;
+            cache?.Add(key!, xdot, warnings);
+        }
+
+        var resultGraph = RootGraph.FromDotString(xdot, coordinateSystem);
+        resultGraph.Warnings = warnings;
+        return resultGraph;
+    }
+
+    /// <summary>
+    /// Start dot.exe to compute a layout, using asynchronous pipes.
+    /// When the timeout expires or the cancellation token is canceled, the dot process is killed.
+    /// </summary>
+    /// <exception cref="ApplicationException">When the Graphviz process did not return successfully</exception>
+    /// <exception cref="TimeoutException">When the timeout expired. The message contains the stderr output so far.</exception>
+    /// <exception cref="OperationCanceledException">When the token was canceled. The message contains the stderr output so far.</exception>
+    /// <returns>stderr may contain warnings, stdout is in utf8 encoding</returns>
+    public static async Task<(byte[] stdout, string stderr)> ExecAsync(Graph input, string format = "xdot", string? outputPath = null,
+        string engine = LayoutEngines.Dot, TimeSpan? timeout = null, CancellationToken cancellationToken = default)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        cancellationToken.ThrowIfCancellationRequested();
+        string arguments = $"-T{format} -K{engine}";
+        if (outputPath != null)
+        {
+            arguments = $"{arguments} -o\"{outputPath}\"";
+        }
+        var inputBytes = Encoding.UTF8.GetBytes(input.ToDotString() ?? "");
+
+        using var process = CreateDotProcess(arguments);
+        process.EnableRaisingEvents = true;
+        var exited = new TaskCompletionSource<bool>(TaskCreationOptions.RunContinuationsAsynchronously);
+        process.Exited += (_, _) => exited.TrySetResult(true);
+        StringBuilder stderr = new StringBuilder();
+        process.ErrorDataReceived += (_, e) =>
+        {
+            lock (stderr)
+                _ = stderr.AppendLine(e.Data);
+        };
+        string StderrSoFar()
+        {
+            lock (stderr)
+                return stderr.ToString().Replace("\r\n", "\n");
+        }
+
+        using var deadline = CancellationTokenSource.CreateLinkedTokenSource(cancellationToken);
+        if (timeout is TimeSpan span)
+            deadline.CancelAfter(span);
+
+        _ = process.Start();
+        // Synchronous pipes, like those on .NET Framework, do not observe the token once a read has started.
+        // Killing the process closes the pipes, which ends any pending read or write.
+        using var killOnDeadline = deadline.Token.Register(() => Kill(process));
+        process.BeginErrorReadLine();
+        using var memoryStream = new MemoryStream();
+        try
+        {
+            // Read stdout while writing stdin, because dot may start writing before it read all input
+            var readTask = process.StandardOutput.BaseStream.CopyToAsync(memoryStream, 81920, deadline.Token);
+            using (var stdin = process.StandardInput.BaseStream)
+                await stdin.WriteAsync(inputBytes, 0, inputBytes.Length, deadline.Token).ConfigureAwait(false);
+            await readTask.ConfigureAwait(false);
+            await exited.Task.ConfigureAwait(false);
+            // A killed process may have closed its output without an error, leaving it truncated
+            deadline.Token.ThrowIfCancellationRequested();
+        }
+        catch (Exception e) when (deadline.IsCancellationRequested && (e is OperationCanceledException || e is IOException))
+        {
+            Kill(process);
+            if (cancellationToken.IsCancellationRequested)
+                throw new OperationCanceledException($"The Graphviz process was canceled. Error details so far: {StderrSoFar()}", e, cancellationToken);
+            throw new TimeoutException($"The Graphviz process did not finish within {timeout}. Error details so far: {StderrSoFar()}", e);
+        }
+        catch
+        {
+            Kill(process);
+            throw;
+        }
+
+        // Make sure all stderr output has been received
+        process.WaitForExit();
+        if (process.ExitCode != 0)
+        {
+            throw new ApplicationException($"Process exited with code {process.ExitCode}. Error details: {StderrSoFar()}");
+        }
+        return (memoryStream.ToArray(), StderrSoFar());
+    }
+
+    private static void Kill(Process process)
+    {
+        try
+        {
+            process.Kill();
+        }
+        catch (InvalidOperationException)
+        {
+            // The process exited in the meantime
+        }
+        catch (System.ComponentModel.Win32Exception)
+        {
+            // The process is exiting
+        }
+    }
 }
 
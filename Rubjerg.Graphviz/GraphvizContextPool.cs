@@ -0,0 +1,204 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+using static Rubjerg.Graphviz.FFI.GraphvizFFI;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// A pool of graphviz contexts for computing layouts in-process with <see cref="Graph.ComputeLayout"/>.
+/// Without a pool, all layouts share a single global context that lives as long as the application,
+/// together with the plugins, font caches and error state that accumulate in it.
+/// The contexts of this pool are recycled after a number of layouts, when the native memory of the process
+/// has grown too much, or when a layout on them failed.
+///
+/// A graph keeps the context it was laid out with until <see cref="Graph.FreeLayout"/> is called,
+/// or until the graph is closed. A recycled context is only freed after all of its layouts have been freed.
+///
+/// This pool is used by <see cref="Graph.ComputeLayout"/> when it is installed as <see cref="RootGraph.ContextPool"/>.
+/// </summary>
+public sealed class GraphvizContextPool : IDisposable
+{
+    private readonly object _mutex = new object();
+    private readonly List<GraphvizContext> _contexts = new List<GraphvizContext>();
+    private readonly byte[] _pluginNames;
+    private readonly int[] _pluginOffsets;
+    private bool _disposed = false;
+    private long _created = 0;
+    private long _recycled = 0;
+
+    /// <summary>
+    /// The maximum number of contexts that are in use at the same time, not counting recycled contexts
+    /// that still hold layouts.
+    /// </summary>
+    public int Size { get; }
+    /// <summary>
+    /// The number of layouts after which a context is recycled.
+    /// </summary>
+    public int MaxLayoutsPerContext { get; }
+    /// <summary>
+    /// A context is recycled once the native memory of the process has grown by more than this many bytes
+    /// since the context was created. Graphviz does not report the memory of a single context, so the native
+    /// memory is estimated as the working set minus the managed heap.
+    /// </summary>
+    public long MaxMemoryGrowth { get; }
+    /// <summary>
+    /// The plugin libraries that are loaded into every context, e.g. "dot_layout" and "core".
+    /// When empty, the plugins are found through the graphviz configuration file, like for the global context.
+    /// </summary>
+    public IReadOnlyList<string> BuiltinPlugins { get; }
+    /// <summary>
+    /// Whether plugins that are not builtin are loaded on demand through the graphviz configuration file.
+    /// </summary>
+    public bool DemandLoading { get; }
+
+    public long ContextsCreated => Interlocked.Read(ref _created);
+    public long ContextsRecycled => Interlocked.Read(ref _recycled);
+
+    public GraphvizContextPool(int size = 4, int maxLayoutsPerContext = 1000, long maxMemoryGrowth = 256L << 20,
+        IReadOnlyList<string>? builtinPlugins = null, bool demandLoading = true)
+    {
+        if (size < 1)
+            throw new ArgumentOutOfRangeException(nameof(size), "The pool must contain at least one context.");
+        if (maxLayoutsPerContext < 1)
+            throw new ArgumentOutOfRangeException(nameof(maxLayoutsPerContext));
+        if (maxMemoryGrowth < 0)
+            throw new ArgumentOutOfRangeException(nameof(maxMemoryGrowth));
+        Size = size;
+        MaxLayoutsPerContext = maxLayoutsPerContext;
+        MaxMemoryGrowth = maxMemoryGrowth;
+        BuiltinPlugins = builtinPlugins?.ToList() ?? new List<string>();
+        DemandLoading = demandLoading;
+        (_pluginNames, _pluginOffsets) = FFI.Marshaling.MarshalColumnToUtf8(BuiltinPlugins);
+    }
+
+    /// <summary>
+    /// Borrow the least used context for a layout. Every call must be paired with a call to <see cref="Release"/>.
+    /// </summary>
+    internal GraphvizContext Acquire()
+    {
+        var unused = new List<GraphvizContext>();
+        try
+        {
+            lock (_mutex)
+            {
+                if (_disposed)
+                    throw new ObjectDisposedException(nameof(GraphvizContextPool));
+
+                long memory = NativeMemoryEstimate();
+                foreach (var context in _contexts.Where(c => !c.Recycled).ToList())
+                {
+                    if (context.Layouts >= MaxLayoutsPerContext || memory - context.InitialMemory > MaxMemoryGrowth)
+                    {
+                        Recycle(context, unused);
+                        _ = Interlocked.Increment(ref _recycled);
+                    }
+                }
+
+                var available = _contexts.Where(c => !c.Recycled).OrderBy(c => c.Leases).FirstOrDefault();
+                if (available is null || (available.Leases > 0 && _contexts.Count(c => !c.Recycled) < Size))
+                {
+                    available = new GraphvizContext(CreateContext(), memory);
+                    _contexts.Add(available);
+                    _ = Interlocked.Increment(ref _created);
+                }
+                available.Leases++;
+                available.Layouts++;
+                return available;
+            }
+        }
+        finally
+        {
+            foreach (var context in unused)
+                _ = RjFreeContext(context.Ptr);
+        }
+    }
+
+    /// <param name="healthy">False if the layout failed, in which case the context is recycled</param>
+    internal void Release(GraphvizContext context, bool healthy)
+    {
+        var unused = new List<GraphvizContext>();
+        lock (_mutex)
+        {
+            context.Leases--;
+            if (!healthy && !context.Recycled)
+            {
+                Recycle(context, unused);
+                _ = Interlocked.Increment(ref _recycled);
+            }
+            else if (context.Recycled && context.Leases == 0)
+                unused.Add(context);
+            foreach (var c in unused)
+                _ = _contexts.Remove(c);
+        }
+        foreach (var c in unused)
+            _ = RjFreeContext(c.Ptr);
+    }
+
+    private void Recycle(GraphvizContext context, List<GraphvizContext> unused)
+    {
+        context.Recycled = true;
+        if (context.Leases == 0)
+        {
+            _ = _contexts.Remove(context);
+            unused.Add(context);
+        }
+    }
+
+    private IntPtr CreateContext()
+    {
+        IntPtr ptr = BuiltinPlugins.Count == 0 && DemandLoading
+            ? GvContext()
+            : RjContextPlugins(_pluginNames, _pluginOffsets, DemandLoading);
+        if (ptr == IntPtr.Zero)
+            throw new InvalidOperationException(
+                $"Could not create a graphviz context with the plugins {string.Join(", ", BuiltinPlugins)}.");
+        return ptr;
+    }
+
+    private static long NativeMemoryEstimate() => Environment.WorkingSet - GC.GetTotalMemory(false);
+
+    /// <summary>
+    /// Free all contexts that do not hold any layouts. The other contexts are freed as soon as their layouts are freed.
+    /// </summary>
+    public void Dispose()
+    {
+        var unused = new List<GraphvizContext>();
+        lock (_mutex)
+        {
+            if (_disposed)
+                return;
+            _disposed = true;
+            foreach (var context in _contexts.Where(c => !c.Recycled).ToList())
+                Recycle(context, unused);
+        }
+        foreach (var context in unused)
+            _ = RjFreeContext(context.Ptr);
+    }
+}
+
+/// <summary>
+/// A graphviz context of a <see cref="GraphvizContextPool"/>, with the bookkeeping that decides when it is recycled.
+/// All fields are protected by the mutex of the pool.
+/// </summary>
+internal sealed class GraphvizContext
+{
+    public GraphvizContext(IntPtr ptr, long initialMemory)
+    {
+        Ptr = ptr;
+        InitialMemory = initialMemory;
+    }
+
+    public IntPtr Ptr { get; }
+    public long InitialMemory { get; }
+    /// <summary>
+    /// The number of layouts computed with this context.
+    /// </summary>
+    public int Layouts { get; set; }
+    /// <summary>
+    /// The number of layouts that have not been freed yet.
+    /// </summary>
+    public int Leases { get; set; }
+    public bool Recycled { get; set; }
+}
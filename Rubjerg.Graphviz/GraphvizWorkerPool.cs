@@ -0,0 +1,302 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// A pool of long-lived dot processes for computing xdot layouts.
+/// Starting dot, loading its plugins and initializing its fonts takes a significant amount of time
+/// compared to laying out a typical graph. The workers in this pool are started once, and then
+/// receive one graph after another over stdin.
+///
+/// Every worker runs in its own process, so a crashing graphviz does not take down the application.
+/// A worker that crashed is discarded, and a new one is started when needed.
+///
+/// This pool can be used directly, or it can be installed as <see cref="GraphvizCommand.WorkerPool"/>.
+/// </summary>
+public sealed class GraphvizWorkerPool : IDisposable
+{
+    private readonly object _mutex = new object();
+    private readonly List<GraphvizWorker> _idle = new List<GraphvizWorker>();
+    private int _busy = 0;
+    private bool _disposed = false;
+
+    /// <summary>
+    /// The maximum number of dot processes that are alive at the same time.
+    /// </summary>
+    public int Size { get; }
+
+    public GraphvizWorkerPool(int size = 4)
+    {
+        if (size < 1)
+            throw new ArgumentOutOfRangeException(nameof(size), "The pool must contain at least one worker.");
+        Size = size;
+    }
+
+    /// <summary>
+    /// Compute the layout in one of the workers, and return a new graph, which is a copy of the old
+    /// graph with the xdot information added to it.
+    /// </summary>
+    public RootGraph CreateLayout(Graph input, string engine = LayoutEngines.Dot, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
+    {
+        var (stdout, stderr) = Exec(input, engine);
+        var resultGraph = RootGraph.FromDotString(stdout, coordinateSystem);
+        resultGraph.Warnings = stderr;
+        return resultGraph;
+    }
+
+    /// <summary>
+    /// Compute the xdot output for the given graph in one of the workers.
+    /// Blocks while all workers are busy.
+    /// </summary>
+    /// <exception cref="ApplicationException">When the Graphviz process did not produce any output</exception>
+    /// <returns>stdout with unix line endings, stderr may contain warnings</returns>
+    public (string stdout, string stderr) Exec(Graph input, string engine = LayoutEngines.Dot)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        string dot = input.ToDotString() ?? "";
+
+        var worker = Acquire(engine);
+        try
+        {
+            return worker.Run(dot);
+        }
+        finally
+        {
+            Release(worker);
+        }
+    }
+
+    private GraphvizWorker Acquire(string engine)
+    {
+        GraphvizWorker? evicted = null;
+        try
+        {
+            lock (_mutex)
+            {
+                while (_busy >= Size && !_disposed)
+                    _ = Monitor.Wait(_mutex);
+                if (_disposed)
+                    throw new ObjectDisposedException(nameof(GraphvizWorkerPool));
+
+                _busy++;
+                var idle = _idle.FirstOrDefault(w => w.Engine == engine);
+                if (idle is not null)
+                {
+                    _ = _idle.Remove(idle);
+                    return idle;
+                }
+
+                // Make room for a worker with the requested engine
+                if (_idle.Count + _busy > Size)
+                {
+                    evicted = _idle[0];
+                    _idle.RemoveAt(0);
+                }
+            }
+        }
+        finally
+        {
+            evicted?.Dispose();
+        }
+
+        try
+        {
+            return new GraphvizWorker(engine);
+        }
+        catch
+        {
+            lock (_mutex)
+            {
+                _busy--;
+                Monitor.Pulse(_mutex);
+            }
+            throw;
+        }
+    }
+
+    private void Release(GraphvizWorker worker)
+    {
+        bool keep;
+        lock (_mutex)
+        {
+            _busy--;
+            keep = worker.IsAlive && !_disposed;
+            if (keep)
+                _idle.Add(worker);
+            Monitor.Pulse(_mutex);
+        }
+        if (!keep)
+            worker.Dispose();
+    }
+
+    /// <summary>
+    /// Stop all idle workers. Workers that are busy are stopped as soon as they finish.
+    /// </summary>
+    public void Dispose()
+    {
+        List<GraphvizWorker> idle;
+        lock (_mutex)
+        {
+            _disposed = true;
+            idle = _idle.ToList();
+            _idle.Clear();
+            Monitor.PulseAll(_mutex);
+        }
+        foreach (var worker in idle)
+            worker.Dispose();
+    }
+}
+
+/// <summary>
+/// A single dot process that lays out the graphs it receives over stdin.
+///
+/// Dot reads any number of graphs from stdin, and writes the output for each of them to stdout.
+/// To find out where the output of a graph ends, each graph is followed by two empty sentinel graphs
+/// with a unique name. The output of the first sentinel marks the end of the output of the graph.
+/// The second sentinel makes sure dot never has to wait for more input before it can finish
+/// parsing the first one. Its output precedes the output of the next graph, and is skipped there.
+/// </summary>
+internal sealed class GraphvizWorker : IDisposable
+{
+    private readonly Process _process;
+    private readonly StreamWriter _stdin;
+    private readonly StreamReader _stdout;
+    private readonly StringBuilder _stderr = new StringBuilder();
+    private readonly string _sentinelPrefix = "rj_frame_" + Guid.NewGuid().ToString("N") + "_";
+    private long _requestCounter = 0;
+    private bool _broken = false;
+
+    public string Engine { get; }
+
+    public bool IsAlive => !_broken && !_process.HasExited;
+
+    public GraphvizWorker(string engine)
+    {
+        Engine = engine;
+        _process = GraphvizCommand.CreateDotProcess($"-Txdot -K{engine}");
+        _process.ErrorDataReceived += (_, e) =>
+        {
+            lock (_stderr)
+                _ = _stderr.AppendLine(e.Data);
+        };
+        _ = _process.Start();
+        _process.BeginErrorReadLine();
+        _stdin = new StreamWriter(_process.StandardInput.BaseStream, new UTF8Encoding(false)) { NewLine = "\n" };
+        _stdout = _process.StandardOutput;
+    }
+
+    /// <returns>stdout with unix line endings, stderr may contain warnings</returns>
+    public (string stdout, string stderr) Run(string dot)
+    {
+        string id = _sentinelPrefix + _requestCounter++.ToString(CultureInfo.InvariantCulture);
+        string terminator = id + "a";
+        string output;
+        try
+        {
+            _stdin.Write(dot);
+            _stdin.WriteLine();
+            _stdin.WriteLine($"graph {terminator} {{}}");
+            _stdin.WriteLine($"graph {id}b {{}}");
+            _stdin.Flush();
+            output = ReadUntilSentinel(terminator);
+        }
+        catch (IOException)
+        {
+            // We lost the connection with the process, which probably means it crashed.
+            // The exception is handled below.
+            _broken = true;
+            output = "";
+        }
+
+        if (_broken)
+        {
+            _process.WaitForExit();
+            throw new ApplicationException($"Process exited with code {_process.ExitCode}. Error details: {TakeStderr()}");
+        }
+        if (output.Length == 0)
+            throw new ApplicationException($"Graphviz did not produce any output. Error details: {TakeStderr()}");
+        return (output, TakeStderr());
+    }
+
+    private string ReadUntilSentinel(string terminator)
+    {
+        const string sentinelStart = "graph ";
+        var output = new StringBuilder();
+        string? sentinel = null;
+        while (true)
+        {
+            string? line = _stdout.ReadLine();
+            if (line is null)
+            {
+                _broken = true;
+                return "";
+            }
+
+            if (sentinel is not null)
+            {
+                // The output of a sentinel ends with the unindented closing brace of the graph
+                if (line == "}")
+                {
+                    if (sentinel == terminator)
+                        return output.ToString();
+                    sentinel = null;
+                }
+            }
+            else if (line.StartsWith(sentinelStart + _sentinelPrefix, StringComparison.Ordinal))
+            {
+                sentinel = line.Substring(sentinelStart.Length).TrimEnd(' ', '{');
+            }
+            else
+            {
+                _ = output.Append(line).Append('\n');
+            }
+        }
+    }
+
+    /// <summary>
+    /// Return the stderr output collected so far. Since stderr is read asynchronously,
+    /// warnings may occasionally be attributed to the next graph.
+    /// </summary>
+    private string TakeStderr()
+    {
+        lock (_stderr)
+        {
+            var result = _stderr.ToString().Replace("\r\n", "\n");
+            _ = _stderr.Clear();
+            return result;
+        }
+    }
+
+    public void Dispose()
+    {
+        try
+        {
+            // Dot exits when it reaches the end of its input
+            _stdin.Dispose();
+        }
+        catch (IOException)
+        {
+            // The process is already gone
+        }
+
+        if (!_process.WaitForExit(1000))
+        {
+            try
+            {
+                _process.Kill();
+            }
+            catch (InvalidOperationException)
+            {
+                // The process exited in the meantime
+            }
+        }
+        _process.Dispose();
+    }
+}
@@ -0,0 +1,323 @@
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// A cache of xdot layouts, keyed by the fingerprint of the input graph, its name and the layout engine.
+/// Recently used layouts are kept in memory. Optionally, layouts are also stored in a directory on disk,
+/// such that they survive the process.
+///
+/// The cache can be used directly, or it can be installed as <see cref="GraphvizCommand.LayoutCache"/>,
+/// in which case <see cref="GraphvizCommand.CreateLayout"/> and <see cref="Graph.CreateLayout"/> consult it.
+/// Layouts computed in-process with <see cref="Graph.ComputeLayout"/> are not cached, because they live in
+/// graphviz data structures that cannot be restored from xdot.
+/// </summary>
+public sealed class LayoutCache
+{
+    private sealed class Entry
+    {
+        public Entry(string key, string xdot, string warnings)
+        {
+            Key = key;
+            Xdot = xdot;
+            Warnings = warnings;
+        }
+
+        public string Key { get; }
+        public string Xdot { get; }
+        public string Warnings { get; }
+        public long Size => 2L * (Xdot.Length + Warnings.Length);
+    }
+
+    private const string FileExtension = ".xdotcache";
+
+    private readonly object _mutex = new object();
+    private readonly Dictionary<string, LinkedListNode<Entry>> _entries = new Dictionary<string, LinkedListNode<Entry>>();
+    // Most recently used first
+    private readonly LinkedList<Entry> _lru = new LinkedList<Entry>();
+    private long _memoryBytes = 0;
+    private long _diskBytes = 0;
+    private long _hits = 0;
+    private long _diskHits = 0;
+    private long _misses = 0;
+
+    /// <summary>
+    /// The maximum total size in bytes of the layouts kept in memory.
+    /// </summary>
+    public long MaxMemoryBytes { get; }
+    /// <summary>
+    /// The directory in which layouts are stored, or null if the cache only lives in memory.
+    /// </summary>
+    public string? Directory { get; }
+    /// <summary>
+    /// The maximum total size in bytes of the layouts stored on disk.
+    /// </summary>
+    public long MaxDiskBytes { get; }
+    /// <summary>
+    /// The attributes that are part of the cache key. When null, all attributes that are declared
+    /// in the input graph are part of the key.
+    /// </summary>
+    public IReadOnlyList<string>? Attributes { get; set; }
+
+    /// <summary>
+    /// The number of layouts that were found in the cache, including <see cref="DiskHits"/>.
+    /// </summary>
+    public long Hits => Interlocked.Read(ref _hits);
+    /// <summary>
+    /// The number of layouts that were found on disk, but not in memory.
+    /// </summary>
+    public long DiskHits => Interlocked.Read(ref _diskHits);
+    public long Misses => Interlocked.Read(ref _misses);
+    public long MemoryBytes => Interlocked.Read(ref _memoryBytes);
+    public long DiskBytes => Interlocked.Read(ref _diskBytes);
+
+    public LayoutCache(long maxMemoryBytes = 64 << 20, string? directory = null, long maxDiskBytes = 1L << 30)
+    {
+        if (maxMemoryBytes < 0)
+            throw new ArgumentOutOfRangeException(nameof(maxMemoryBytes));
+        if (maxDiskBytes < 0)
+            throw new ArgumentOutOfRangeException(nameof(maxDiskBytes));
+        MaxMemoryBytes = maxMemoryBytes;
+        MaxDiskBytes = maxDiskBytes;
+        if (directory is not null)
+        {
+            Directory = Path.GetFullPath(directory);
+            _ = System.IO.Directory.CreateDirectory(Directory);
+            _diskBytes = DiskFiles().Sum(f => f.Length);
+        }
+    }
+
+    /// <summary>
+    /// Compute the layout of the input with the given function, unless it is in the cache already.
+    /// The function returns the xdot output with unix line endings, and the warnings.
+    /// </summary>
+    public RootGraph CreateLayout(Graph input, string engine, CoordinateSystem coordinateSystem,
+        Func<Graph, string, (string xdot, string warnings)> compute)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        _ = compute ?? throw new ArgumentNullException(nameof(compute));
+        string key = CreateKey(input, engine);
+        if (!TryGet(key, out string xdot, out string warnings))
+        {
+            (xdot, warnings) = compute(input, engine);
+            Add(key, xdot, warnings);
+        }
+
+        var resultGraph = RootGraph.FromDotString(xdot, coordinateSystem);
+        resultGraph.Warnings = warnings;
+        return resultGraph;
+    }
+
+    /// <summary>
+    /// The key consists of the engine, the fingerprint of the graph, and a hash of the name of the graph,
+    /// which ends up in the xdot output. It only contains characters that are valid in file names.
+    /// </summary>
+    public string CreateKey(Graph input, string engine)
+    {
+        _ = input ?? throw new ArgumentNullException(nameof(input));
+        _ = engine ?? throw new ArgumentNullException(nameof(engine));
+        var attributes = Attributes ?? input.DeclaredAttributeNames();
+        var fingerprint = input.ComputeFingerprint(attributes);
+
+        // FNV-1a, which is stable across processes, unlike string.GetHashCode
+        ulong nameHash = 14695981039346656037UL;
+        foreach (byte b in Encoding.UTF8.GetBytes(input.GetName() ?? ""))
+            nameHash = (nameHash ^ b) * 1099511628211UL;
+
+        var safeEngine = new string(engine.Where(char.IsLetterOrDigit).ToArray());
+        return $"{safeEngine}-{fingerprint}-{nameHash.ToString("x16", CultureInfo.InvariantCulture)}";
+    }
+
+    public bool TryGet(string key, out string xdot, out string warnings)
+    {
+        lock (_mutex)
+        {
+            if (_entries.TryGetValue(key, out var node))
+            {
+                _lru.Remove(node);
+                _lru.AddFirst(node);
+                _ = Interlocked.Increment(ref _hits);
+                xdot = node.Value.Xdot;
+                warnings = node.Value.Warnings;
+                return true;
+            }
+        }
+
+        if (TryReadFromDisk(key, out xdot, out warnings))
+        {
+            AddToMemory(new Entry(key, xdot, warnings));
+            _ = Interlocked.Increment(ref _hits);
+            _ = Interlocked.Increment(ref _diskHits);
+            return true;
+        }
+
+        _ = Interlocked.Increment(ref _misses);
+        return false;
+    }
+
+    public void Add(string key, string xdot, string warnings)
+    {
+        _ = key ?? throw new ArgumentNullException(nameof(key));
+        var entry = new Entry(key, xdot ?? throw new ArgumentNullException(nameof(xdot)), warnings ?? "");
+        AddToMemory(entry);
+        WriteToDisk(entry);
+    }
+
+    /// <summary>
+    /// Remove all layouts from memory and from disk. The statistics are not reset.
+    /// </summary>
+    public void Clear()
+    {
+        lock (_mutex)
+        {
+            _entries.Clear();
+            _lru.Clear();
+            _ = Interlocked.Exchange(ref _memoryBytes, 0);
+            if (Directory is null)
+                return;
+            foreach (var file in DiskFiles())
+                TryDelete(file);
+            _ = Interlocked.Exchange(ref _diskBytes, DiskFiles().Sum(f => f.Length));
+        }
+    }
+
+    public void ResetStatistics()
+    {
+        _ = Interlocked.Exchange(ref _hits, 0);
+        _ = Interlocked.Exchange(ref _diskHits, 0);
+        _ = Interlocked.Exchange(ref _misses, 0);
+    }
+
+    private void AddToMemory(Entry entry)
+    {
+        if (entry.Size > MaxMemoryBytes)
+            return;
+        lock (_mutex)
+        {
+            if (_entries.TryGetValue(entry.Key, out var existing))
+            {
+                _lru.Remove(existing);
+                _ = _entries.Remove(entry.Key);
+                _ = Interlocked.Add(ref _memoryBytes, -existing.Value.Size);
+            }
+            _entries[entry.Key] = _lru.AddFirst(entry);
+            _ = Interlocked.Add(ref _memoryBytes, entry.Size);
+
+            while (_memoryBytes > MaxMemoryBytes)
+            {
+                var last = _lru.Last!;
+                _lru.RemoveLast();
+                _ = _entries.Remove(last.Value.Key);
+                _ = Interlocked.Add(ref _memoryBytes, -last.Value.Size);
+            }
+        }
+    }
+
+    private IEnumerable<FileInfo> DiskFiles()
+    {
+        return new DirectoryInfo(Directory!).EnumerateFiles("*" + FileExtension);
+    }
+
+    private bool TryReadFromDisk(string key, out string xdot, out string warnings)
+    {
+        xdot = "";
+        warnings = "";
+        if (Directory is null)
+            return false;
+        string path = Path.Combine(Directory, key + FileExtension);
+        try
+        {
+            using (var reader = new BinaryReader(File.OpenRead(path), Encoding.UTF8))
+            {
+                warnings = reader.ReadString();
+                xdot = reader.ReadString();
+            }
+            // The last write time tells which files were used least recently
+            File.SetLastWriteTimeUtc(path, DateTime.UtcNow);
+            return true;
+        }
+        catch (Exception e) when (e is IOException || e is UnauthorizedAccessException || e is FormatException)
+        {
+            // Missing, truncated, corrupted or concurrently removed files are cache misses
+            return false;
+        }
+    }
+
+    private void WriteToDisk(Entry entry)
+    {
+        if (Directory is null)
+            return;
+        string path = Path.Combine(Directory, entry.Key + FileExtension);
+        string temporary = path + "." + Guid.NewGuid().ToString("N") + ".tmp";
+        try
+        {
+            using (var writer = new BinaryWriter(File.Create(temporary), Encoding.UTF8))
+            {
+                writer.Write(entry.Warnings);
+                writer.Write(entry.Xdot);
+            }
+            long size = new FileInfo(temporary).Length;
+            if (size > MaxDiskBytes)
+            {
+                File.Delete(temporary);
+                return;
+            }
+
+            lock (_mutex)
+            {
+                var existing = new FileInfo(path);
+                if (existing.Exists)
+                {
+                    _ = Interlocked.Add(ref _diskBytes, -existing.Length);
+                    existing.Delete();
+                }
+                File.Move(temporary, path);
+                _ = Interlocked.Add(ref _diskBytes, size);
+                if (_diskBytes > MaxDiskBytes)
+                    EvictFromDisk();
+            }
+        }
+        catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+        {
+            // The disk tier is best effort, failing to store a layout only costs a future cache miss
+            TryDelete(new FileInfo(temporary));
+        }
+    }
+
+    /// <summary>
+    /// Delete the least recently used files until the disk tier fits within its limit again.
+    /// Files of other processes that share the directory are taken into account as well.
+    /// </summary>
+    private void EvictFromDisk()
+    {
+        var files = DiskFiles().OrderBy(f => f.LastWriteTimeUtc).ToList();
+        long total = files.Sum(f => f.Length);
+        foreach (var file in files)
+        {
+            if (total <= MaxDiskBytes)
+                break;
+            if (TryDelete(file))
+                total -= file.Length;
+        }
+        _ = Interlocked.Exchange(ref _diskBytes, total);
+    }
+
+    private static bool TryDelete(FileInfo file)
+    {
+        try
+        {
+            file.Delete();
+            return true;
+        }
+        catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+        {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+using System;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// Options for <see cref="GraphvizCommand.CreateLayout(Graph, LayoutOptions)"/>.
+/// </summary>
+public sealed class LayoutOptions
+{
+    public string Engine { get; set; } = LayoutEngines.Dot;
+    public CoordinateSystem CoordinateSystem { get; set; } = CoordinateSystem.BottomLeft;
+    /// <summary>
+    /// Lay out the connected components of the graph separately, in parallel dot processes, and pack the
+    /// results into a single layout. Nodes that share a subgraph are kept in the same component, such that
+    /// clusters and rank constraints are respected. This pays off for graphs that consist of many islands,
+    /// since the layout time of dot grows superlinearly with the size of the graph.
+    ///
+    /// The label of the root graph is not placed in a layout that is split into components.
+    /// </summary>
+    public bool SplitComponents { get; set; } = false;
+    /// <summary>
+    /// The maximum number of components that are laid out at the same time.
+    /// </summary>
+    public int MaxDegreeOfParallelism { get; set; } = Environment.ProcessorCount;
+    /// <summary>
+    /// The space in points between packed components. Graphviz uses 8 points by default.
+    /// </summary>
+    public double ComponentMargin { get; set; } = 8;
+}
@@ -0,0 +1,28 @@
+using System;
+
+namespace Rubjerg.Graphviz;
+
+/// <summary>
+/// The outcome of laying out a single graph of a batch, see <see cref="GraphvizCommand.CreateLayouts"/>.
+/// </summary>
+public sealed class LayoutResult
+{
+    public Graph Input { get; }
+    /// <summary>
+    /// The graph with the layout information, or null if the layout failed.
+    /// Any warnings of graphviz are in <see cref="RootGraph.Warnings"/>.
+    /// </summary>
+    public RootGraph? Layout { get; }
+    /// <summary>
+    /// The reason why the layout failed, or null if it succeeded.
+    /// </summary>
+    public Exception? Error { get; }
+    public bool Succeeded => Error is null;
+
+    internal LayoutResult(Graph input, RootGraph? layout, Exception? error)
+    {
+        Input = input;
+        Layout = layout;
+        Error = error;
+    }
+}
@@ -50,6 +50,17 @@ public static void IntroduceAttributeHtml(RootGraph root, string name, string de
         AgattrHtml(root._ptr, 1, name, deflt);
     }
 
+    /// <summary>
+    /// Get a handle to the attribute for nodes in the given graph, for fast repeated access.
+    /// If the attribute was not introduced yet, it is introduced with the given default.
+    /// </summary>
+    public static AttributeHandle GetAttributeHandle(RootGraph root, string name, string deflt = "")
+    {
+        return AttributeHandle.GetOrIntroduce(root, 1, name, deflt);
+    }
+
+    internal override int AttributeKind => 1;
+
     public IEnumerable<Edge> EdgesOut(Graph? graph = null)
     {
         IntPtr graph_ptr = graph?._ptr ?? MyRootGraph._ptr;
@@ -1,4 +1,5 @@
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Linq;
 using static Rubjerg.Graphviz.FFI.GraphvizFFI;
@@ -16,6 +17,23 @@ public enum GraphType
     StrictUndirected = 3
 }
 
+/// <summary>
+/// Determines how calls into graphviz are serialized.
+/// </summary>
+public enum LockingMode
+{
+    /// <summary>
+    /// All calls into graphviz share a single global lock.
+    /// </summary>
+    Global = 0,
+    /// <summary>
+    /// Calls that only concern a single root graph lock that root graph,
+    /// so separate root graphs can be used from separate threads in parallel.
+    /// Layouting, rendering and parsing still share a global lock.
+    /// </summary>
+    PerRootGraph = 1
+}
+
 /// <summary>
 /// Wraps a cgraph root graph.
 /// NB: If there is no .net wrapper left that points to any part of a root graph, the root graph is destroyed.
@@ -26,9 +44,27 @@ public sealed class RootGraph : Graph
 {
     private long _added_pressure = 0;
     private bool _closed = false;
+    // The contexts of the in-process layouts of this graph and its subgraphs that have not been freed yet
+    private readonly Dictionary<IntPtr, (GraphvizContextPool pool, GraphvizContext context)> _layoutContexts =
+        new Dictionary<IntPtr, (GraphvizContextPool, GraphvizContext)>();
 
     public CoordinateSystem CoordinateSystem { get; }
     /// <summary>
+    /// How calls into graphviz are serialized, see <see cref="Graphviz.LockingMode"/>.
+    /// Set this at startup, before the first graph is created. Once graphviz has locked a graph,
+    /// the mode is fixed, and setting another mode throws an <see cref="InvalidOperationException"/>.
+    /// </summary>
+    public static LockingMode LockingMode
+    {
+        get => FFI.GraphvizFFI.LockingMode;
+        set => FFI.GraphvizFFI.LockingMode = value;
+    }
+    /// <summary>
+    /// When set, <see cref="Graph.ComputeLayout"/> borrows a context from this pool,
+    /// instead of using the global graphviz context.
+    /// </summary>
+    public static GraphvizContextPool? ContextPool { get; set; }
+    /// <summary>
     /// Contains any warnings that Graphviz generated during computation of the layout.
     /// </summary>
     public string? Warnings { get; internal set; }
@@ -53,11 +89,53 @@ public void Close()
         {
             _closed = true;
             _ = Agclose(_ptr);
+            ReleaseLayoutContexts();
             if (_added_pressure > 0)
                 GC.RemoveMemoryPressure(_added_pressure);
         }
     }
 
+    /// <returns>The context that the given (sub)graph was laid out with, or the global context</returns>
+    internal IntPtr LayoutContext(IntPtr graph)
+    {
+        lock (_layoutContexts)
+        {
+            return _layoutContexts.TryGetValue(graph, out var lease) ? lease.context.Ptr : GVC;
+        }
+    }
+
+    /// <summary>
+    /// Record that the given (sub)graph holds a layout computed with a context of the given pool,
+    /// or that it does not hold such a layout anymore if the pool is null.
+    /// </summary>
+    internal void SetLayoutContext(IntPtr graph, GraphvizContextPool? pool, GraphvizContext? context)
+    {
+        (GraphvizContextPool? pool, GraphvizContext? context) previous = (null, null);
+        lock (_layoutContexts)
+        {
+            if (_layoutContexts.TryGetValue(graph, out var lease))
+                previous = lease;
+            if (pool is null || context is null)
+                _ = _layoutContexts.Remove(graph);
+            else
+                _layoutContexts[graph] = (pool, context);
+        }
+        if (previous.pool is not null && previous.context is not null)
+            previous.pool.Release(previous.context, healthy: true);
+    }
+
+    private void ReleaseLayoutContexts()
+    {
+        List<(GraphvizContextPool pool, GraphvizContext context)> leases;
+        lock (_layoutContexts)
+        {
+            leases = _layoutContexts.Values.ToList();
+            _layoutContexts.Clear();
+        }
+        foreach (var (pool, context) in leases)
+            pool.Release(context, healthy: true);
+    }
+
     /// <summary>
     /// Notify the garbage collector of the approximate allocated unmanaged memory used by this graph.
     /// Because it is too much of a hassle to track the exact amount of unmanaged bytes allocated,
@@ -66,12 +144,17 @@ public void Close()
     /// This method ignores memory used by attributes.
     /// </summary>
     public void UpdateMemoryPressure()
+    {
+        UpdateMemoryPressure(Nodes().Count(), Edges().Count());
+    }
+
+    private void UpdateMemoryPressure(long nodeCount, long edgeCount)
     {
         if (_added_pressure > 0)
             GC.RemoveMemoryPressure(_added_pressure);
 
         // Up memory pressure proportional to the amount of unmanaged memory in use.
-        long unmanaged_bytes_estimate = Nodes().Count() * 104 + Edges().Count() * 64;
+        long unmanaged_bytes_estimate = nodeCount * 104 + edgeCount * 64;
         if (unmanaged_bytes_estimate > 0)
             GC.AddMemoryPressure(unmanaged_bytes_estimate);
         _added_pressure = unmanaged_bytes_estimate;
@@ -91,21 +174,167 @@ public static RootGraph CreateNew(GraphType graphtype, string? name = null, Coor
         return new RootGraph(ptr, coordinateSystem);
     }
 
+    /// <summary>
+    /// Create a new root graph with the same type as the given graph, containing a deepcopy of its contents.
+    /// </summary>
+    internal static RootGraph CreateClone(Graph graph, string? name, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
+    {
+        IntPtr ptr = RjCloneGraph(graph._ptr, NameString(name));
+        if (ptr == IntPtr.Zero)
+        {
+            throw new InvalidOperationException("Could not create graph");
+        }
+        return new RootGraph(ptr, coordinateSystem);
+    }
+
+    /// <summary>
+    /// Create a new root graph from the tables of a <see cref="GraphBuilder"/>, in a single call into graphviz.
+    /// See rj_build_graph in the wrapper for the layout of the tables.
+    /// </summary>
+    /// <exception cref="ArgumentException">The tables are inconsistent, or an index is out of range</exception>
+    internal static RootGraph CreateFromTables(string? name, GraphType graphtype, byte[] strings, int[] offsets,
+        int nodeCount, int edgeNameCount, int[] tails, int[] heads, int[] edgeNames, int[] attributeKinds,
+        CoordinateSystem coordinateSystem)
+    {
+        ValidateTables(strings, offsets, nodeCount, edgeNameCount, tails, heads, edgeNames, attributeKinds);
+        IntPtr ptr = RjBuildGraph(NameString(name), (int)graphtype, strings, offsets, nodeCount, edgeNameCount,
+            tails, heads, edgeNames, attributeKinds);
+        if (ptr == IntPtr.Zero)
+        {
+            throw new InvalidOperationException("Could not create graph");
+        }
+        var result = new RootGraph(ptr, coordinateSystem);
+        // Strict graphs may have merged some edges, which does not matter for an estimate
+        result.UpdateMemoryPressure(nodeCount, tails.Length);
+        return result;
+    }
+
+    /// <summary>
+    /// Graphviz does not check the tables, so an index out of range would corrupt native memory.
+    /// </summary>
+    private static void ValidateTables(byte[] strings, int[] offsets, int nodeCount, int edgeNameCount,
+        int[] tails, int[] heads, int[] edgeNames, int[] attributeKinds)
+    {
+        if (nodeCount < 0)
+            throw new ArgumentOutOfRangeException(nameof(nodeCount));
+        if (edgeNameCount < 0)
+            throw new ArgumentOutOfRangeException(nameof(edgeNameCount));
+        int edgeCount = tails.Length;
+        if (heads.Length != edgeCount || edgeNames.Length != edgeCount)
+            throw new ArgumentException("Every edge needs a tail, a head and an edge name index.");
+        for (int i = 0; i < edgeCount; i++)
+        {
+            if ((uint)tails[i] >= (uint)nodeCount)
+                throw new ArgumentOutOfRangeException(nameof(tails), $"Edge {i} has tail {tails[i]}, but there are {nodeCount} nodes.");
+            if ((uint)heads[i] >= (uint)nodeCount)
+                throw new ArgumentOutOfRangeException(nameof(heads), $"Edge {i} has head {heads[i]}, but there are {nodeCount} nodes.");
+            if (edgeNames[i] >= edgeNameCount)
+                throw new ArgumentOutOfRangeException(nameof(edgeNames), $"Edge {i} has name {edgeNames[i]}, but there are {edgeNameCount} names.");
+        }
+
+        long stringCount = (long)nodeCount + edgeNameCount;
+        foreach (int kind in attributeKinds)
+        {
+            if (kind != 1 && kind != 2)
+                throw new ArgumentOutOfRangeException(nameof(attributeKinds), $"Unknown attribute kind {kind}.");
+            stringCount += 2 + (kind == 1 ? nodeCount : edgeCount);
+        }
+        if (offsets.Length != stringCount + 1)
+            throw new ArgumentException($"The tables hold {stringCount} strings, but there are {offsets.Length} offsets.", nameof(offsets));
+        if (offsets[0] < 0 || offsets[offsets.Length - 1] > strings.Length)
+            throw new ArgumentOutOfRangeException(nameof(offsets));
+        for (int i = 1; i < offsets.Length; i++)
+        {
+            if (offsets[i] < offsets[i - 1])
+                throw new ArgumentOutOfRangeException(nameof(offsets), $"Offset {i} is smaller than the one before it.");
+        }
+    }
+
+    /// <summary>
+    /// Read a graph from the remainder of the stream, which must hold a snapshot written by <see cref="Graph.SaveSnapshot"/>.
+    /// This is much faster than parsing the same graph from DOT.
+    /// </summary>
+    /// <exception cref="InvalidDataException">The stream does not hold a valid snapshot</exception>
+    public static RootGraph LoadSnapshot(Stream stream, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
+    {
+        _ = stream ?? throw new ArgumentNullException(nameof(stream));
+        IntPtr ptr = RjReadSnapshot(ReadToEnd(stream));
+        if (ptr == IntPtr.Zero)
+        {
+            throw new InvalidDataException("The stream does not contain a valid graph snapshot.");
+        }
+        var result = new RootGraph(ptr, coordinateSystem);
+        result.UpdateMemoryPressure();
+        return result;
+    }
+
+    /// <summary>
+    /// The remainder of the stream. The buffer of a memory stream is used directly, without copying it.
+    /// </summary>
+    private static ArraySegment<byte> ReadToEnd(Stream stream)
+    {
+        if (stream is MemoryStream memory && memory.TryGetBuffer(out var buffer))
+        {
+            int position = (int)memory.Position;
+            memory.Position = memory.Length;
+            return new ArraySegment<byte>(buffer.Array!, buffer.Offset + position, (int)memory.Length - position);
+        }
+
+        using var copy = stream.CanSeek ? new MemoryStream((int)Math.Max(0, stream.Length - stream.Position)) : new MemoryStream();
+        stream.CopyTo(copy);
+        return new ArraySegment<byte>(copy.GetBuffer(), 0, (int)copy.Length);
+    }
+
+    /// <summary>
+    /// Split the graph into a new root graph for each connected component, see <see cref="LayoutOptions.SplitComponents"/>.
+    /// </summary>
+    internal static RootGraph[] SplitComponents(Graph graph)
+    {
+        return RjSplitComponents(graph._ptr).Select(ptr => new RootGraph(ptr, CoordinateSystem.BottomLeft)).ToArray();
+    }
+
+    /// <summary>
+    /// Read a graph from a dot file. UTF-8 files are streamed into graphviz directly,
+    /// without loading the whole file in memory.
+    /// </summary>
     public static RootGraph FromDotFile(string filename)
     {
-        string input;
-        using (var sr = new StreamReader(filename))
-            input = sr.ReadToEnd();
+        // Graphviz only reads UTF-8, so other encodings are decoded here
+        if (HasUtf16ByteOrderMark(filename))
+        {
+            string input;
+            using (var sr = new StreamReader(filename))
+                input = sr.ReadToEnd();
+            return FromDotString(input);
+        }
 
-        return FromDotString(input);
+        IntPtr ptr = Rjagreadfile(Path.GetFullPath(filename));
+        if (ptr == IntPtr.Zero)
+        {
+            throw new InvalidOperationException("Could not create graph");
+        }
+        var result = new RootGraph(ptr, CoordinateSystem.BottomLeft);
+        result.UpdateMemoryPressure();
+        return result;
+    }
+
+    /// <summary>
+    /// Also covers UTF-32 little endian, whose byte order mark starts with the same bytes.
+    /// Throws the usual exceptions if the file cannot be opened.
+    /// </summary>
+    private static bool HasUtf16ByteOrderMark(string filename)
+    {
+        using var stream = File.OpenRead(filename);
+        int first = stream.ReadByte();
+        int second = stream.ReadByte();
+        return (first == 0xFF && second == 0xFE) || (first == 0xFE && second == 0xFF);
     }
 
     public static RootGraph FromDotString(string graph, CoordinateSystem coordinateSystem = CoordinateSystem.BottomLeft)
     {
-        // Just to be safe, make sure the input has unix line endings. Graphviz does not properly support
-        // windows line endings passed to stdin when it comes to attribute line continuations.
-        var normalizedDotString = graph.Replace("\r\n", "\n");
-        IntPtr ptr = Rjagmemread(normalizedDotString);
+        // Windows line endings are normalized while reading, since graphviz does not properly support
+        // them when it comes to attribute line continuations.
+        IntPtr ptr = Rjagmemread(graph);
         if (ptr == IntPtr.Zero)
         {
             throw new InvalidOperationException("Could not create graph");